@@ -1,6 +1,8 @@
 #ifndef APU_H
 #define APU_H
 
+#define OAM_DMA_CYCLES  513 // +1 on odd CPU cycle
+
 void apu_reset(void)
 {
     memset(apu_reg, 0, sizeof(apu_reg));
@@ -28,12 +30,21 @@ void apu_write(uint32 addr, uint32 data)
     {
         case 0x14:
         {
-            uint32 i;
             uint32 dma_addr = data << 8;
-            for (i = 0; i < 256; i++)
+            const uint8 *src = cpu_page_ptr(dma_addr);
+            if (src)
+            {
+                memcpy(oam, src, 256);
+            }
+            else // I/O page
             {
-                ((uint8*)oam)[i] = cpu_read(dma_addr + i);
+                uint32 i;
+                for (i = 0; i < 256; i++)
+                {
+                    ((uint8*)oam)[i] = cpu_read(dma_addr + i);
+                }
             }
+            cpu_stall(OAM_DMA_CYCLES);
             break;
         }
         case 0x16:
@@ -0,0 +1,203 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+// streams a ROM image out of a raw .nes, .nes.gz or .zip file without buffering the whole file
+
+#include <stdio.h>
+
+#include "common.h"
+#include "inflate.h"
+
+typedef struct
+{
+    inflate_sink sink;
+    void *ctx;
+    uint32 crc;
+} ARCHIVE;
+
+INFLATE archive_inflate;
+
+static void archive_sink(void *ctx, const uint8 *data, uint32 size)
+{
+    ARCHIVE *a = (ARCHIVE*)ctx;
+    a->crc = crc32_update(a->crc, data, size);
+    a->sink(a->ctx, data, size);
+}
+
+// passes size bytes (or everything up to the end of the file) through the sink
+static uint32 archive_copy(INFLATE *s, uint32 size)
+{
+    uint8 buf[4096];
+    uint32 count = 0, total = 0;
+
+    while (size--)
+    {
+        uint32 b = inflate_bits(s, 8);
+        if (s->in_pad)
+            break;
+        buf[count++] = (uint8)b;
+        if (count == sizeof(buf))
+        {
+            s->sink(s->ctx, buf, count);
+            total += count;
+            count = 0;
+        }
+    }
+
+    if (count)
+    {
+        s->sink(s->ctx, buf, count);
+        total += count;
+    }
+    return total;
+}
+
+static void archive_skip(INFLATE *s, uint32 size)
+{
+    while (size-- && !s->in_pad)
+    {
+        inflate_bits(s, 8);
+    }
+}
+
+static sint32 archive_gzip(INFLATE *s, ARCHIVE *a)
+{
+    uint32 method = inflate_bits(s, 8);
+    uint32 flags = inflate_bits(s, 8);
+    uint32 crc;
+
+    if (method != 8)
+        return 0;
+
+    archive_skip(s, 6);                         // mtime, xfl, os
+
+    if (flags & 0x04)                           // FEXTRA
+        archive_skip(s, inflate_bits(s, 16));
+    if (flags & 0x08)                           // FNAME
+        while (inflate_bits(s, 8) && !s->in_pad);
+    if (flags & 0x10)                           // FCOMMENT
+        while (inflate_bits(s, 8) && !s->in_pad);
+    if (flags & 0x02)                           // FHCRC
+        archive_skip(s, 2);
+
+    if (s->in_pad || inflate_run(s) < 0)
+        return 0;
+
+    inflate_align(s);
+    crc = inflate_u32(s);
+    return (crc == a->crc) && (inflate_u32(s) == s->out_pos);
+}
+
+static uint32 archive_is_nes(const char *name)
+{
+    uint32 len = (uint32)strlen(name);
+    return len >= 4 && name[len - 4] == '.' &&
+        (name[len - 3] | 0x20) == 'n' && (name[len - 2] | 0x20) == 'e' && (name[len - 1] | 0x20) == 's';
+}
+
+// walks the local headers up to the first *.nes entry
+static sint32 archive_zip(INFLATE *s, ARCHIVE *a)
+{
+    for (;;)
+    {
+        char name[256];
+        uint32 flags, method, crc, csize, name_len, extra_len, i;
+
+        if (inflate_u32(s) != 0x04034B50 || s->in_pad)
+            return 0;
+
+        inflate_bits(s, 16);                    // version
+        flags = inflate_bits(s, 16);
+        method = inflate_bits(s, 16);
+        inflate_u32(s);                         // time, date
+        crc = inflate_u32(s);
+        csize = inflate_u32(s);
+        inflate_u32(s);                         // uncompressed size
+        name_len = inflate_bits(s, 16);
+        extra_len = inflate_bits(s, 16);
+
+        for (i = 0; i < name_len; i++)
+        {
+            uint32 c = inflate_bits(s, 8);
+            if (i + 1 < sizeof(name))
+                name[i] = (char)c;
+        }
+        name[(name_len < sizeof(name)) ? name_len : sizeof(name) - 1] = 0;
+        archive_skip(s, extra_len);
+
+        if (s->in_pad)
+            return 0;
+
+        if (!archive_is_nes(name))
+        {
+            if (flags & 0x08)                   // sizes are only in the data descriptor
+                return 0;
+            archive_skip(s, csize);
+            continue;
+        }
+
+        if (method == 0)
+        {
+            if (archive_copy(s, csize) != csize)
+                return 0;
+        }
+        else if (method == 8)
+        {
+            if (inflate_run(s) < 0)
+                return 0;
+        }
+        else
+        {
+            return 0;
+        }
+
+        return (flags & 0x08) || (crc == a->crc);
+    }
+}
+
+// detects the container by its magic, returns 0 on I/O, format or checksum errors
+sint32 archive_load(const char *path, inflate_sink sink, void *ctx)
+{
+    INFLATE *s = &archive_inflate;
+    ARCHIVE a;
+    uint32 b0, b1;
+    sint32 res = 0;
+    FILE *f = fopen(path, "rb");
+
+    if (!f)
+        return 0;
+
+    a.sink = sink;
+    a.ctx = ctx;
+    a.crc = crc32_update(0, NULL, 0);
+    inflate_init(s, f, archive_sink, &a);
+
+    b0 = inflate_bits(s, 8);
+    b1 = inflate_bits(s, 8);
+
+    if (b0 == 0x1F && b1 == 0x8B)
+    {
+        res = archive_gzip(s, &a);
+    }
+    else if (b0 == 'P' && b1 == 'K')
+    {
+        // the bit buffer is empty here, put the signature back for the zip walker
+        s->bits = b0 | (b1 << 8);
+        s->bit_count = 16;
+        res = archive_zip(s, &a);
+    }
+    else if (!s->in_pad)
+    {
+        uint8 head[2];
+        head[0] = (uint8)b0;
+        head[1] = (uint8)b1;
+        archive_sink(&a, head, 2);
+        archive_copy(s, 0xFFFFFFFF);
+        res = 1;
+    }
+
+    fclose(f);
+    return res;
+}
+
+#endif
@@ -0,0 +1,446 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nes.h"
+#include "timer.h"
+
+// microbenchmarks of the hot paths plus full-ROM workloads driven by input movies,
+// results are written as flat JSON and compared against a saved baseline
+
+#define BENCH_REPEAT        5
+#define BENCH_METRICS       64
+
+typedef struct
+{
+    char name[64];
+    double value;           // ns, lower is better
+} METRIC;
+
+METRIC metrics[BENCH_METRICS];
+uint32 metric_count;
+volatile uint32 bench_sink;
+
+void metric_add(const char *name, double value)
+{
+    if (metric_count < BENCH_METRICS)
+    {
+        sprintf(metrics[metric_count].name, "%.63s", name);
+        metrics[metric_count].value = value;
+        metric_count++;
+    }
+    printf("%-32s %12.2f ns\n", name, value);
+}
+
+// synthetic NROM cart: a tight mixed-instruction loop at $C000, random CHR
+void bench_cart(void)
+{
+    static const uint8 loop[] = {
+        0xA9, 0x01,             // LDA #$01
+        0x85, 0x10,             // STA $10
+        0xE8,                   // INX
+        0x88,                   // DEY
+        0x69, 0x03,             // ADC #$03
+        0x29, 0x7F,             // AND #$7F
+        0xC9, 0x20,             // CMP #$20
+        0xD0, 0x00,             // BNE +0
+        0xA5, 0x10,             // LDA $10
+        0x1D, 0x00, 0x02,       // ORA $0200,X
+        0xEA,                   // NOP
+        0x4C, 0x00, 0xC0        // JMP $C000
+    };
+    static uint8 rom[16 + 24 * 1024];
+    uint8 *prg = rom + 16;
+    uint8 *chr = prg + 16 * 1024;
+    uint32 i, seed = 1;
+
+    memset(rom, 0, sizeof(rom));
+    memcpy(rom, "NES\x1A\x01\x01\x01\x00", 8);
+    memcpy(prg, loop, sizeof(loop));
+    prg[0x3FF0] = 0x40;                                 // RTI
+    prg[0x3FFA] = 0xF0; prg[0x3FFB] = 0xFF;             // NMI
+    prg[0x3FFC] = 0x00; prg[0x3FFD] = 0xC0;             // RESET
+    prg[0x3FFE] = 0xF0; prg[0x3FFF] = 0xFF;             // IRQ
+
+    for (i = 0; i < 8 * 1024; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        chr[i] = seed >> 16;
+    }
+
+    cart_load(rom);
+    nes_reset();
+
+    for (i = 0; i < 0x1000; i++)
+    {
+        vram_write(0x2000 + i, i * 7);
+    }
+    for (i = 0; i < 32; i++)
+    {
+        vram_write(0x3F00 + i, i);
+    }
+}
+
+void bench_cpu_read(uint32 n)
+{
+    uint32 i, s = 0;
+    for (i = 0; i < n; i++)
+    {
+        uint32 addr = (i & 1) ? (0x8000 | ((i * 0x3A7) & 0x7FFF)) : ((i * 0x1F3) & 0x1FFF);
+        s += cpu_read(addr);
+    }
+    bench_sink = s;
+}
+
+void bench_dispatch(uint32 n)
+{
+    PC = 0xC000;
+    cpu_budget = 0;
+    cpu_clock(n);
+    bench_sink = A;
+}
+
+void bench_adc_sbc(uint32 n)
+{
+    uint32 i;
+    ram[0] = 0x5A;
+    for (i = 0; i < n; i += 2)
+    {
+        PC = 0;
+        ADC_IMM();
+        PC = 0;
+        SBC_IMM();
+    }
+    bench_sink = A;
+}
+
+void bench_vram_ptr(uint32 n)
+{
+    uint32 i, s = 0;
+    for (i = 0; i < n; i++)
+    {
+        s += *get_vram_ptr(0x2000 + ((i * 0x2F1) & 0x1FFF));
+    }
+    bench_sink = s;
+}
+
+void bench_draw_sprite(uint32 n)
+{
+    uint32 i;
+    for (i = 0; i < n; i++)
+    {
+        draw_sprite(i & 0xFF, 0, (i & 3) << 2, i & 3, i & 1, (i * 37) & 0xFF, (i * 29) % 232);
+    }
+}
+
+void bench_draw_bg_row(uint32 n)
+{
+    uint32 i;
+    PPU_MASK = PPU_MASK_EN;
+    for (i = 0; i < n; i++)
+    {
+        PPU_SCROLL = (i * 13) & 0xFF;
+        draw_bg_row(i % 30);
+    }
+}
+
+void bench_oam_dma(uint32 n)
+{
+    uint32 i;
+    for (i = 0; i < n; i++)
+    {
+        apu_write(0x14, (i & 1) ? 0x02 : 0xC0);
+    }
+    cpu_budget = 0;
+}
+
+typedef struct
+{
+    const char *name;
+    void (*func)(uint32 n);
+    uint32 n;               // iterations (cycles for dispatch)
+} MICRO;
+
+static const MICRO micro[] = {
+    { "micro.cpu_read",         bench_cpu_read,     1 << 22 },
+    { "micro.op_dispatch_cycle",bench_dispatch,     1 << 22 },
+    { "micro.adc_sbc",          bench_adc_sbc,      1 << 22 },
+    { "micro.get_vram_ptr",     bench_vram_ptr,     1 << 22 },
+    { "micro.draw_sprite",      bench_draw_sprite,  1 << 16 },
+    { "micro.draw_bg_row",      bench_draw_bg_row,  1 << 12 },
+    { "micro.oam_dma",          bench_oam_dma,      1 << 16 }
+};
+
+void run_micro(void)
+{
+    uint32 i, r;
+
+    for (i = 0; i < sizeof(micro) / sizeof(micro[0]); i++)
+    {
+        double best = 0.0;
+        for (r = 0; r < BENCH_REPEAT; r++)
+        {
+            uint64 t;
+            bench_cart();
+            t = time_ns();
+            micro[i].func(micro[i].n);
+            t = time_ns() - t;
+            if (!r || t < best)
+            {
+                best = (double)t;
+            }
+        }
+        metric_add(micro[i].name, best / micro[i].n);
+    }
+}
+
+// runs a ROM for a fixed number of frames, with input from a movie if given
+// best per-frame time of one rom on the given ppu tier
+sint32 run_rom_tier(const char *name, const char *rom, const char *movie, uint32 frames, const PPU_TIER *tier, const char *suffix)
+{
+    char metric[64];
+    uint8 joy_live[2] = { 0, 0 };
+    uint32 r, frame;
+    double best = 0.0;
+
+    for (r = 0; r < BENCH_REPEAT; r++)
+    {
+        uint64 t;
+
+        if (!nes_load(rom))
+        {
+            printf("can't load %s\n", rom);
+            return 0;
+        }
+        nes_reset();
+        ppu_tier = tier;
+
+        if (movie && !movie_replay(movie))
+        {
+            printf("can't replay %s\n", movie);
+            return 0;
+        }
+        movie_input(joy_live);
+
+        t = time_ns();
+        for (frame = 0; frame < frames;)
+        {
+            if (nes_scanline())
+            {
+                movie_input(joy_live);
+                frame++;
+            }
+        }
+        t = time_ns() - t;
+        movie_close();
+
+        if (!r || t < best)
+        {
+            best = (double)t;
+        }
+    }
+
+    sprintf(metric, "rom.%.40s.frame%s", name, suffix);
+    metric_add(metric, best / frames);
+    return 1;
+}
+
+sint32 run_rom(const char *name, const char *rom, const char *movie, uint32 frames)
+{
+    return run_rom_tier(name, rom, movie, frames, &ppu_tier_fast, "") &&
+        run_rom_tier(name, rom, movie, frames, &ppu_tier_dot, "_dot");
+}
+
+// workload file lines: <name> <rom> <movie or -> <frames>
+sint32 run_workloads(const char *path)
+{
+    char line[1024], name[64], rom[448], movie[448];
+    uint32 frames;
+    FILE *f = fopen(path, "r");
+
+    if (!f)
+    {
+        printf("can't open %s\n", path);
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), f))
+    {
+        if (line[0] == '#' || sscanf(line, "%63s %447s %447s %u", name, rom, movie, &frames) != 4)
+            continue;
+        if (!run_rom(name, rom, strcmp(movie, "-") ? movie : NULL, frames))
+        {
+            fclose(f);
+            return 0;
+        }
+    }
+
+    fclose(f);
+    return 1;
+}
+
+sint32 save_json(const char *path)
+{
+    uint32 i;
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return 0;
+    fprintf(f, "{\n");
+    for (i = 0; i < metric_count; i++)
+    {
+        fprintf(f, "  \"%s\": %.3f%s\n", metrics[i].name, metrics[i].value, (i + 1 < metric_count) ? "," : "");
+    }
+    fprintf(f, "}\n");
+    fclose(f);
+    return 1;
+}
+
+// flat {"name": number, ...} as written by save_json
+sint32 load_json(const char *path, METRIC *out, uint32 *count)
+{
+    char key[64];
+    double value;
+    sint32 c;
+    uint32 n = 0, k;
+    FILE *f = fopen(path, "r");
+
+    if (!f)
+        return 0;
+
+    while ((c = fgetc(f)) != EOF)
+    {
+        if (c != '"')
+            continue;
+
+        for (k = 0; (c = fgetc(f)) != EOF && c != '"'; )
+        {
+            if (k + 1 < sizeof(key))
+                key[k++] = (char)c;
+        }
+        key[k] = 0;
+
+        if (fscanf(f, " : %lf", &value) == 1 && n < BENCH_METRICS)
+        {
+            strcpy(out[n].name, key);
+            out[n].value = value;
+            n++;
+        }
+    }
+
+    fclose(f);
+    *count = n;
+    return 1;
+}
+
+// returns the number of metrics slower than baseline * (1 + threshold%)
+uint32 compare(const char *path, double threshold)
+{
+    static METRIC base[BENCH_METRICS];
+    uint32 count, i, j, regressions = 0;
+
+    if (!load_json(path, base, &count))
+    {
+        printf("can't read baseline %s\n", path);
+        return 1;
+    }
+
+    for (i = 0; i < metric_count; i++)
+    {
+        for (j = 0; j < count; j++)
+        {
+            if (!strcmp(metrics[i].name, base[j].name))
+            {
+                double delta = (metrics[i].value / base[j].value - 1.0) * 100.0;
+                uint32 bad = delta > threshold;
+                printf("%-32s %+7.1f%%%s\n", metrics[i].name, delta, bad ? "  REGRESSION" : "");
+                regressions += bad;
+                break;
+            }
+        }
+        if (j == count)
+        {
+            printf("%-32s %8s  NEW\n", metrics[i].name, "");
+        }
+    }
+
+    // a dropped or renamed workload must not pass the gate silently
+    for (j = 0; j < count; j++)
+    {
+        for (i = 0; i < metric_count; i++)
+        {
+            if (!strcmp(metrics[i].name, base[j].name))
+                break;
+        }
+        if (i == metric_count)
+        {
+            printf("%-32s %8s  MISSING\n", base[j].name, "");
+            regressions++;
+        }
+    }
+
+    return regressions;
+}
+
+int main(int argc, char **argv)
+{
+    const char *out = NULL;
+    const char *baseline = NULL;
+    const char *workloads = NULL;
+    const char *rom = NULL;
+    const char *movie = NULL;
+    uint32 frames = 600;
+    double threshold = 5.0;
+    uint32 micro_only = 0;
+    int i;
+
+    sram_enabled = 0;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-out") && i + 1 < argc)
+            out = argv[++i];
+        else if (!strcmp(argv[i], "-baseline") && i + 1 < argc)
+            baseline = argv[++i];
+        else if (!strcmp(argv[i], "-threshold") && i + 1 < argc)
+            threshold = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-workloads") && i + 1 < argc)
+            workloads = argv[++i];
+        else if (!strcmp(argv[i], "-rom") && i + 1 < argc)
+            rom = argv[++i];
+        else if (!strcmp(argv[i], "-movie") && i + 1 < argc)
+            movie = argv[++i];
+        else if (!strcmp(argv[i], "-frames") && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-micro"))
+            micro_only = 1;
+        else
+        {
+            printf("usage: %s [-micro] [-rom file.nes [-movie file.nesm] [-frames N]] [-workloads file.txt]\n"
+                   "          [-out results.json] [-baseline baseline.json [-threshold percent]]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    run_micro();
+
+    if (!micro_only)
+    {
+        if (rom && !run_rom("rom", rom, movie, frames))
+            return -1;
+        if (workloads && !run_workloads(workloads))
+            return -1;
+    }
+
+    if (out && !save_json(out))
+    {
+        printf("can't write %s\n", out);
+        return -1;
+    }
+
+    if (baseline && compare(baseline, threshold))
+    {
+        return 1;
+    }
+
+    return 0;
+}
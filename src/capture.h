@@ -0,0 +1,307 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+// headless frame capture to a file or pipe ("-" is stdout)
+// formats: y4m (4:4:4), raw rgb24 or raw 8-bit colour indices
+// frames are handed over to a writer thread through two slots, so encoding never blocks emulation
+// unless the consumer is more than a frame behind
+//
+// with changed-only output each distinct frame carries a repeat count:
+// y4m puts it in the frame header ("FRAME XREPEAT=n"), raw formats prefix the frame with a u32 LE count
+
+#include <stdio.h>
+
+#include "common.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <io.h>
+    #include <fcntl.h>
+#else
+    #include <pthread.h>
+    #include <unistd.h>
+#endif
+
+#define CAPTURE_Y4M         0
+#define CAPTURE_RGB         1
+#define CAPTURE_INDEXED     2
+
+#define CAPTURE_SIZE        (FRAME_WIDTH * FRAME_HEIGHT)
+
+typedef struct
+{
+    uint8 data[CAPTURE_SIZE];
+    uint32 repeat;
+    uint32 ready;                   // final and owned by the writer
+} CAPTURE_SLOT;
+
+FILE *capture_file;
+uint32 capture_format;
+uint32 capture_changed;
+sint32 capture_cur = -1;            // slot holding the latest frame, still counting repeats
+uint32 capture_quit;
+uint32 capture_frames;              // frames submitted
+uint32 capture_written;             // frame records written
+
+CAPTURE_SLOT capture_slot[2];
+
+uint8 capture_yuv[64][3];           // per colour index, BT.601 limited range
+
+#ifdef _WIN32
+    HANDLE capture_thread;
+    CRITICAL_SECTION capture_lock;
+    CONDITION_VARIABLE capture_cond;
+
+    #define CAPTURE_LOCK()      EnterCriticalSection(&capture_lock)
+    #define CAPTURE_UNLOCK()    LeaveCriticalSection(&capture_lock)
+    #define CAPTURE_WAIT()      SleepConditionVariableCS(&capture_cond, &capture_lock, INFINITE)
+    #define CAPTURE_SIGNAL()    WakeAllConditionVariable(&capture_cond)
+#else
+    pthread_t capture_thread;
+    pthread_mutex_t capture_lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t capture_cond = PTHREAD_COND_INITIALIZER;
+
+    #define CAPTURE_LOCK()      pthread_mutex_lock(&capture_lock)
+    #define CAPTURE_UNLOCK()    pthread_mutex_unlock(&capture_lock)
+    #define CAPTURE_WAIT()      pthread_cond_wait(&capture_cond, &capture_lock)
+    #define CAPTURE_SIGNAL()    pthread_cond_broadcast(&capture_cond)
+#endif
+
+static void capture_put32(uint32 v)
+{
+    uint8 b[4];
+    b[0] = v & 0xFF;
+    b[1] = (v >> 8) & 0xFF;
+    b[2] = (v >> 16) & 0xFF;
+    b[3] = v >> 24;
+    fwrite(b, 1, 4, capture_file);
+}
+
+static void capture_write(const CAPTURE_SLOT *slot)
+{
+    uint8 line[FRAME_WIDTH * 3];
+    uint32 x, y, plane;
+    const uint8 *src;
+
+    if (capture_format == CAPTURE_Y4M)
+    {
+        if (capture_changed)
+            fprintf(capture_file, "FRAME XREPEAT=%u\n", slot->repeat);
+        else
+            fprintf(capture_file, "FRAME\n");
+
+        for (plane = 0; plane < 3; plane++)
+        {
+            src = slot->data;
+            for (y = 0; y < FRAME_HEIGHT; y++)
+            {
+                for (x = 0; x < FRAME_WIDTH; x++)
+                {
+                    line[x] = capture_yuv[*src++][plane];
+                }
+                fwrite(line, 1, FRAME_WIDTH, capture_file);
+            }
+        }
+    }
+    else
+    {
+        if (capture_changed)
+            capture_put32(slot->repeat);
+
+        if (capture_format == CAPTURE_INDEXED)
+        {
+            fwrite(slot->data, 1, CAPTURE_SIZE, capture_file);
+        }
+        else
+        {
+            src = slot->data;
+            for (y = 0; y < FRAME_HEIGHT; y++)
+            {
+                uint8 *dst = line;
+                for (x = 0; x < FRAME_WIDTH; x++)
+                {
+                    uint32 c = screen_pal[*src++];
+                    *dst++ = (c >> 16) & 0xFF;
+                    *dst++ = (c >> 8) & 0xFF;
+                    *dst++ = c & 0xFF;
+                }
+                fwrite(line, 1, sizeof(line), capture_file);
+            }
+        }
+    }
+
+    capture_written++;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI capture_proc(LPVOID arg)
+#else
+static void* capture_proc(void *arg)
+#endif
+{
+    uint32 i = 0;
+
+    (void)arg;
+
+    CAPTURE_LOCK();
+    for (;;)
+    {
+        while (!capture_slot[i].ready && !capture_quit)
+        {
+            CAPTURE_WAIT();
+        }
+        if (!capture_slot[i].ready)
+            break;
+
+        CAPTURE_UNLOCK();
+        capture_write(capture_slot + i);
+        CAPTURE_LOCK();
+
+        capture_slot[i].ready = 0;
+        CAPTURE_SIGNAL();
+        i ^= 1;
+    }
+    CAPTURE_UNLOCK();
+
+    return 0;
+}
+
+static void capture_init_yuv(void)
+{
+    uint32 i;
+    for (i = 0; i < 64; i++)
+    {
+        sint32 r = (screen_pal[i] >> 16) & 0xFF;
+        sint32 g = (screen_pal[i] >> 8) & 0xFF;
+        sint32 b = screen_pal[i] & 0xFF;
+        capture_yuv[i][0] = (uint8)(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8));
+        capture_yuv[i][1] = (uint8)(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+        capture_yuv[i][2] = (uint8)(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
+    }
+}
+
+sint32 capture_open(const char *path, uint32 format, uint32 changed)
+{
+    if (!strcmp(path, "-"))
+    {
+        // keep stdout for the stream only, text output goes to stderr from now on
+    #ifdef _WIN32
+        int fd = _dup(1);
+        _dup2(2, 1);
+        _setmode(fd, _O_BINARY);
+        capture_file = _fdopen(fd, "wb");
+    #else
+        int fd = dup(1);
+        dup2(2, 1);
+        capture_file = fdopen(fd, "wb");
+    #endif
+    }
+    else
+    {
+        capture_file = fopen(path, "wb");
+    }
+
+    if (!capture_file)
+        return 0;
+
+    capture_format = format;
+    capture_changed = changed;
+    capture_cur = -1;
+    capture_quit = 0;
+    capture_frames = 0;
+    capture_written = 0;
+    capture_slot[0].ready = 0;
+    capture_slot[1].ready = 0;
+
+    if (format == CAPTURE_Y4M)
+    {
+        capture_init_yuv();
+        // NTSC frame rate is 60.0988
+        fprintf(capture_file, "YUV4MPEG2 W%d H%d F60099:1000 Ip A1:1 C444\n", FRAME_WIDTH, FRAME_HEIGHT);
+    }
+
+#ifdef _WIN32
+    InitializeCriticalSection(&capture_lock);
+    InitializeConditionVariable(&capture_cond);
+    capture_thread = CreateThread(NULL, 0, capture_proc, NULL, 0, NULL);
+    if (!capture_thread)
+#else
+    if (pthread_create(&capture_thread, NULL, capture_proc, NULL))
+#endif
+    {
+        fclose(capture_file);
+        capture_file = NULL;
+        return 0;
+    }
+
+    return 1;
+}
+
+// called once per frame with the indexed framebuffer
+void capture_frame(const uint8 *screen)
+{
+    sint32 next;
+
+    if (!capture_file)
+        return;
+
+    capture_frames++;
+
+    // the current slot isn't handed to the writer yet, so it's safe to read here
+    if (capture_changed && capture_cur >= 0 && !memcmp(screen, capture_slot[capture_cur].data, CAPTURE_SIZE))
+    {
+        capture_slot[capture_cur].repeat++;
+        return;
+    }
+
+    next = (capture_cur < 0) ? 0 : (capture_cur ^ 1);
+
+    CAPTURE_LOCK();
+    while (capture_slot[next].ready)
+    {
+        CAPTURE_WAIT();
+    }
+    CAPTURE_UNLOCK();
+
+    memcpy(capture_slot[next].data, screen, CAPTURE_SIZE);
+    capture_slot[next].repeat = 1;
+
+    // the previous frame is final now that its repeat count is known
+    if (capture_cur >= 0)
+    {
+        CAPTURE_LOCK();
+        capture_slot[capture_cur].ready = 1;
+        CAPTURE_SIGNAL();
+        CAPTURE_UNLOCK();
+    }
+
+    capture_cur = next;
+}
+
+void capture_close(void)
+{
+    if (!capture_file)
+        return;
+
+    CAPTURE_LOCK();
+    if (capture_cur >= 0)
+    {
+        capture_slot[capture_cur].ready = 1;
+    }
+    capture_quit = 1;
+    CAPTURE_SIGNAL();
+    CAPTURE_UNLOCK();
+
+#ifdef _WIN32
+    WaitForSingleObject(capture_thread, INFINITE);
+    CloseHandle(capture_thread);
+    DeleteCriticalSection(&capture_lock);
+#else
+    pthread_join(capture_thread, NULL);
+#endif
+
+    fclose(capture_file);
+    capture_file = NULL;
+}
+
+#endif
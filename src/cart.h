@@ -1,7 +1,10 @@
 #ifndef CART_H
 #define CART_H
 
+#include <stdlib.h>
+
 #include "common.h"
+#include "inflate.h"
 
 typedef struct
 {
@@ -20,31 +23,201 @@ typedef struct
     uint8 def_device;
 } NES_HEADER;
 
-void cart_load(const uint8 *data)
+#define CART_BATTERY        0x02    // flags6
+#define CART_TRAINER        0x04    // flags6
+#define CART_FOUR_SCREEN    0x08    // flags6
+
+NES_HEADER cart_header;
+uint32 cart_crc;                    // CRC32 of the loaded image without the header
+
+// consumes an iNES image in arbitrary chunks
+// PRG and CHR are staged and only replace the running cart once cart_stream_end accepts the image
+typedef struct
 {
-    NES_HEADER *header = (NES_HEADER*)data;
-    
-    data += sizeof(NES_HEADER);
-    if (header->flags6 & 0x04)
+    NES_HEADER header;
+    uint32 store;                   // 0 to only parse the header and CRC
+    uint32 pos;                     // bytes consumed
+    uint32 crc;                     // CRC32 of everything after the 16-byte header
+    uint32 prg_size;
+    uint32 chr_size;
+    uint32 error;                   // rejected header, the rest of the stream is ignored
+    uint8 *prg;                     // staging, store mode only
+    uint8 *chr;
+    uint32 prg_cap;
+    uint32 chr_cap;
+} CART_STREAM;
+
+void cart_stream_begin(CART_STREAM *s, uint32 store)
+{
+    memset(s, 0, sizeof(*s));
+    s->store = store;
+    s->crc = crc32_update(0, NULL, 0);
+}
+
+void cart_stream_free(CART_STREAM *s)
+{
+    free(s->prg);
+    free(s->chr);
+    s->prg = s->chr = NULL;
+}
+
+// staging buffers, the minimums keep map_addr() and the pattern tables in bounds (16K PRG, 8K CHR-RAM)
+static void cart_stream_alloc(CART_STREAM *s)
+{
+    s->prg_cap = (s->prg_size > 0x4000) ? s->prg_size : 0x4000;
+    s->chr_cap = (s->chr_size > 0x2000) ? s->chr_size : 0x2000;
+    s->prg = (uint8*)calloc(1, s->prg_cap);
+    s->chr = (uint8*)calloc(1, s->chr_cap);
+
+    if (!s->prg || !s->chr)
     {
-        data += 512;
+        cart_stream_free(s);
+        s->error = 1;
     }
+}
+
+static void cart_stream_copy(uint8 *dst, uint32 dst_size, uint32 offset, const uint8 *src, uint32 size)
+{
+    if (offset < dst_size)
+    {
+        memcpy(dst + offset, src, (size < dst_size - offset) ? size : dst_size - offset);
+    }
+}
+
+void cart_stream_write(CART_STREAM *s, const uint8 *data, uint32 size)
+{
+    while (size && !s->error)
+    {
+        uint32 trainer, prg, chr, count;
+
+        if (s->pos < sizeof(NES_HEADER))
+        {
+            count = sizeof(NES_HEADER) - s->pos;
+            if (count > size)
+                count = size;
+            memcpy((uint8*)&s->header + s->pos, data, count);
+            s->pos += count;
+            data += count;
+            size -= count;
+
+            if (s->pos == sizeof(NES_HEADER))
+            {
+                s->prg_size = s->header.prg_banks * 1024 * 16;
+                s->chr_size = s->header.chr_banks * 1024 * 8;
+
+                // checked before anything is allocated, the header is untrusted input
+                if (memcmp(&s->header.magic, "NES\x1A", 4) || s->prg_size > PRG_ROM_MAX || s->chr_size > CHR_ROM_MAX)
+                    s->error = 1;
+                else if (s->store)
+                    cart_stream_alloc(s);
+            }
+            continue;
+        }
 
-    ASSERT(!((header->flags7 & 0x0C) == 0x08)); //  TODO file type
+        if (s->store)
+        {
+            trainer = sizeof(NES_HEADER) + ((s->header.flags6 & CART_TRAINER) ? 512 : 0);
+            prg = trainer + s->prg_size;
+            chr = prg + s->chr_size;
 
+            count = size;
+            if (s->pos < trainer)
+            {
+                count = (trainer - s->pos < size) ? trainer - s->pos : size;
+            }
+            else if (s->pos < prg)
+            {
+                count = (prg - s->pos < size) ? prg - s->pos : size;
+                cart_stream_copy(s->prg, s->prg_cap, s->pos - trainer, data, count);
+            }
+            else if (s->pos < chr)
+            {
+                count = (chr - s->pos < size) ? chr - s->pos : size;
+                cart_stream_copy(s->chr, s->chr_cap, s->pos - prg, data, count);
+            }
+        }
+        else
+        {
+            count = size;
+        }
+
+        s->crc = crc32_update(s->crc, data, count);
+        s->pos += count;
+        data += count;
+        size -= count;
+    }
+}
+
+// inflate_sink adapter
+void cart_stream_sink(void *ctx, const uint8 *data, uint32 size)
+{
+    cart_stream_write((CART_STREAM*)ctx, data, size);
+}
+
+// applies the header state, called after load and on every reset
+void cart_reset(void)
+{
     prg_banks_cur = 0;
-    prg_banks = header->prg_banks;
-    chr_banks = header->chr_banks;
+    prg_banks = cart_header.prg_banks;
+    chr_banks = cart_header.chr_banks;
+
+    mapper = (cart_header.flags7 & 0xF0) | (cart_header.flags6 >> 4);
+
+    ppu_mirror((cart_header.flags6 & CART_FOUR_SCREEN) ? TBL_MIRROR_4 : (cart_header.flags6 & 1));
+}
+
+// call once the container checks passed, on failure the running cart is left untouched
+sint32 cart_stream_end(CART_STREAM *s)
+{
+    uint32 size = sizeof(NES_HEADER) + ((s->header.flags6 & CART_TRAINER) ? 512 : 0) + s->prg_size + s->chr_size;
+
+    if (s->error || s->pos < size)
+    {
+        cart_stream_free(s);
+        return 0;
+    }
+
+    ASSERT(!((s->header.flags7 & 0x0C) == 0x08)); //  TODO file type
+
+    if (s->store)
+    {
+    #ifdef LOWMEM
+        free(prg_rom);
+        free(chr_rom);
+        prg_rom = s->prg;
+        chr_rom = s->chr;
+        prg_rom_size = s->prg_cap;
+        chr_rom_size = s->chr_cap;
+        s->prg = s->chr = NULL;
+    #else
+        memset(prg_rom, 0, sizeof(prg_rom));
+        memset(chr_rom, 0, sizeof(chr_rom)); // CHR-RAM stays blank
+        memcpy(prg_rom, s->prg, s->prg_cap);
+        memcpy(chr_rom, s->chr, s->chr_cap);
+        cart_stream_free(s);
+    #endif
+
+        cart_header = s->header;
+        cart_crc = s->crc;
+        cart_reset();
+
+        LOG("mirror: %d", table_mirror);
+        LOG("mapper: %d", mapper);
+    }
 
-    table_mirror = header->flags6 & 1;
-    mapper = (header->flags7 & 0xF0) | (header->flags6 >> 4);
+    return 1;
+}
 
-    LOG("mirror: %d", table_mirror);
-    LOG("mapper: %d", mapper);
+// in-memory iNES image
+sint32 cart_load(const uint8 *data)
+{
+    const NES_HEADER *header = (const NES_HEADER*)data;
+    CART_STREAM s;
 
-    memcpy(prg_rom, data, prg_banks * 1024 * 16);
-    data += prg_banks * 1024 * 16;
-    memcpy(chr_rom, data, (chr_banks ? chr_banks : 1) * 1024 * 8);
+    cart_stream_begin(&s, 1);
+    cart_stream_write(&s, data, sizeof(NES_HEADER) + ((header->flags6 & CART_TRAINER) ? 512 : 0) +
+        header->prg_banks * 1024 * 16 + header->chr_banks * 1024 * 8);
+    return cart_stream_end(&s);
 }
 
 #endif
@@ -3,10 +3,35 @@
 
 #include <string.h>
 
+// superinstructions skip per-instruction hooks, so they can't be combined with tracing or profiling
+#if defined(FUSE) && (defined(TRACE) || defined(PROFILE))
+    #undef FUSE
+#endif
+
+// small-RAM build: cart storage is allocated from the iNES header and the caches shrink
+#ifdef LOWMEM
+    #ifndef TRACE_SIZE
+        #define TRACE_SIZE  (1 << 12)
+    #endif
+    #ifndef MEM_BUDGET
+        #define MEM_BUDGET  (1024 * 1024)
+    #endif
+#endif
+
+#ifdef TRACE
+    void trace_op(void);
+    void trace_dump_assert(void);
+    #define TRACE_OP()      trace_op()
+    #define TRACE_ASSERT()  trace_dump_assert()
+#else
+    #define TRACE_OP()
+    #define TRACE_ASSERT()
+#endif
+
 #ifdef _DEBUG
     #define DBG_BREAK __debugbreak()
     #define LOG(...) { printf(__VA_ARGS__); printf("\n"); }
-    #define ASSERT(expr) if (!(expr)) { LOG("ASSERT:\n  %s:%d\n  %s => %s", __FILE__, __LINE__, __FUNCTION__, #expr); DBG_BREAK; }
+    #define ASSERT(expr) if (!(expr)) { LOG("ASSERT:\n  %s:%d\n  %s => %s", __FILE__, __LINE__, __FUNCTION__, #expr); TRACE_ASSERT(); DBG_BREAK; }
 #else
     #define LOG(...)
     #define ASSERT(x)
@@ -23,6 +48,7 @@ typedef unsigned int    uint32;
 typedef signed char     sint8;
 typedef signed short    sint16;
 typedef signed int      sint32;
+typedef unsigned long long uint64;
 
 static const uint32 screen_pal[64] = {
     0xFF626262, 0xFF001FB2, 0xFF2404C8, 0xFF5200B2, 0xFF730076, 0xFF800024, 0xFF730B00, 0xFF522800, 0xFF244400, 0xFF005700, 0xFF005C00, 0xFF005324, 0xFF003C76, 0xFF000000, 0xFF000000, 0xFF000000,
@@ -41,12 +67,39 @@ typedef struct
     uint8 x;
 } PPU_SPRITE;
 
-uint8 prg_rom[8 * 1024 * 16];
-uint8 chr_rom[2 * 1024 * 8];
+#define PRG_ROM_MAX     (8 * 1024 * 16)
+#define CHR_ROM_MAX     (2 * 1024 * 8)
+#define PRG_WINDOW      0x8000  // CPU-visible PRG ROM, map_addr() stays below this
+
+#ifdef LOWMEM
+    uint8 *prg_rom;             // sized from the header by cart_stream_end
+    uint8 *chr_rom;
+    uint32 prg_rom_size;
+    uint32 chr_rom_size;
+#else
+    uint8 prg_rom[PRG_ROM_MAX];
+    uint8 chr_rom[CHR_ROM_MAX];
+    uint32 prg_rom_size = PRG_ROM_MAX;
+    uint32 chr_rom_size = CHR_ROM_MAX;
+#endif
+
 uint8 ram[2048];
 
+#define PRG_RAM_SIZE    (8 * 1024)
+
+uint8 prg_ram_buf[PRG_RAM_SIZE];
+uint8 *prg_ram = prg_ram_buf;   // $6000-$7FFF, points into the .sav mapping for battery carts
+uint32 prg_ram_dirty;           // one bit per 256-byte page
+
+#define TBL_MIRROR_H        0
+#define TBL_MIRROR_V        1
+#define TBL_MIRROR_S0       2
+#define TBL_MIRROR_S1       3
+#define TBL_MIRROR_4        4
+
 uint32 table_mirror;
-uint8 table_name[2][1024];
+uint8 table_name[4][1024];
+uint8 *table_page[4];
 uint8 table_pal[32];
 
 uint8 apu_reg[24];
@@ -60,6 +113,9 @@ uint32 mapper;
 
 uint32 cpu_read(uint32 addr);
 void cpu_write(uint32 addr, uint8 data);
+uint8* cpu_page_ptr(uint32 addr);
+void cpu_stall(uint32 cycles);
 void cpu_nmi(void);
+void ppu_mirror(uint32 mode);
 
 #endif
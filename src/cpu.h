@@ -12,6 +12,38 @@ uint32 Y;
 uint32 S;
 uint32 PC;
 
+#define CPU_LINE_CYCLES 114 // ~341 / 3 PPU dots per scanline
+
+uint64 cpu_cycles;
+sint32 cpu_budget;
+
+#ifdef PROFILE
+    void prof_op(uint32 op);
+    void prof_stall(uint32 cycles);
+    void prof_call(uint32 addr);
+    void prof_ret(void);
+    #define PROF_OP(op)         prof_op(op)
+    #define PROF_STALL(cycles)  prof_stall(cycles)
+    #define PROF_CALL(addr)     prof_call(addr)
+    #define PROF_RET()          prof_ret()
+#else
+    #define PROF_OP(op)
+    #define PROF_STALL(cycles)
+    #define PROF_CALL(addr)
+    #define PROF_RET()
+#endif
+
+#ifdef FUSE
+    uint32 fuse_step(void);
+    void fuse_invalidate(uint32 offset);
+    uint8 fuse_map[PRG_WINDOW];         // fused sequence id per mapped PRG ROM offset, 0 if none
+    #define FUSE_STEP()             if (PC >= 0x8000 && fuse_map[map_addr(PC)] && fuse_step()) continue
+    #define FUSE_INVALIDATE(offset) fuse_invalidate(offset)
+#else
+    #define FUSE_STEP()
+    #define FUSE_INVALIDATE(offset)
+#endif
+
 #define P_C (1 << 0)
 #define P_Z (1 << 1)
 #define P_I (1 << 2)
@@ -41,8 +73,11 @@ uint32 PC;
     if (V >= 0)\
         P |= P_C
 
-#define READ(ADDR)      cpu_read(ADDR)
-#define WRITE(ADDR, V)  cpu_write(ADDR, V);
+// can be redefined before including cpu.h to run the core on a different bus
+#ifndef READ
+    #define READ(ADDR)      cpu_read(ADDR)
+    #define WRITE(ADDR, V)  cpu_write(ADDR, V);
+#endif
 
 #define FETCH()         READ(PC++)
 
@@ -181,7 +216,7 @@ uint32 POP_16(void)
 #define OP_INX(MODE) X = (X + 1) & 0xFF; SET_ZN(X)
 #define OP_INY(MODE) Y = (Y + 1) & 0xFF; SET_ZN(Y)
 #define OP_JMP(MODE) PC = MODE##_ADDR()
-#define OP_JSR(MODE) uint32 addr = MODE##_ADDR(); PC--; PUSH_16(PC); PC = addr
+#define OP_JSR(MODE) uint32 addr = MODE##_ADDR(); PC--; PUSH_16(PC); PC = addr; PROF_CALL(addr)
 #define OP_LDA(MODE) LD(A, MODE)
 #define OP_LDX(MODE) LD(X, MODE)
 #define OP_LDY(MODE) LD(Y, MODE)
@@ -231,8 +266,8 @@ uint32 POP_16(void)
     SET_C(f & 0x01);\
     WRITE(addr, t)
 
-#define OP_RTI(MODE) P = POP_8() & ~(P_B | P_U); PC = POP_16()
-#define OP_RTS(MODE) PC = POP_16() + 1
+#define OP_RTI(MODE) P = POP_8() & ~(P_B | P_U); PC = POP_16(); PROF_RET()
+#define OP_RTS(MODE) PC = POP_16() + 1; PROF_RET()
 
 #define OP_SBC(MODE)\
     uint32 v = MODE() ^ 0x00FF;\
@@ -261,6 +296,9 @@ uint32 POP_16(void)
 #define IMPL_U(u)
 
 #define DECL(n, m) n##_##m,
+#define NAME_N(n, m) #n,
+#define NAME_M(n, m) #m,
+#define NAME_U(u) "???",
 //#define IMPL(n, m) void n##_##m(void) { LOG("%04X %s (%s)", PC - 1, #n, #m); OP_##n(MODE_##m); }
 #define IMPL(n, m) void n##_##m(void) { OP_##n(MODE_##m); }
 
@@ -288,6 +326,48 @@ OP_TABLE(IMPL, IMPL_U)
 
 static const op_func op_table[] = { OP_TABLE(DECL, DECL_U) };
 
+const char *op_name[256] = { OP_TABLE(NAME_N, NAME_U) };
+const char *op_mode[256] = { OP_TABLE(NAME_M, NAME_U) };
+
+// instruction length in bytes
+#define OP_LEN_IMP 1
+#define OP_LEN_IMM 2
+#define OP_LEN_REL 2
+#define OP_LEN_ZP0 2
+#define OP_LEN_ZPX 2
+#define OP_LEN_ZPY 2
+#define OP_LEN_IZX 2
+#define OP_LEN_IZY 2
+#define OP_LEN_ABS 3
+#define OP_LEN_ABX 3
+#define OP_LEN_ABY 3
+#define OP_LEN_IND 3
+
+#define LEN(n, m) OP_LEN_##m,
+#define LEN_U(u) 1,
+
+static const uint8 op_len[256] = { OP_TABLE(LEN, LEN_U) };
+
+// base cycles, without page crossing and branch penalties
+static const uint8 op_cycles[256] = {
+    7, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    6, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+    2, 6, 2, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5,
+    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+    2, 5, 2, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4,
+    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7
+};
+
 void cpu_reset(void)
 {
     P = P_U | P_B;
@@ -298,6 +378,9 @@ void cpu_reset(void)
     PC = 0xFFFC;
     PC = MODE_ABS_ADDR();
 
+    cpu_cycles = 0;
+    cpu_budget = 0;
+
     memset(ram, 0, sizeof(ram));
 }
 
@@ -319,6 +402,10 @@ uint32 cpu_read(uint32 addr)
         addr &= 0x07FF;
         return ram[addr];
     }
+    else if (addr >= 0x6000 && addr <= 0x7FFF)
+    {
+        return prg_ram[addr & 0x1FFF];
+    }
     else if (addr >= 0x2000 && addr <= 0x3FFF)
     {
         addr &= 0x0007;
@@ -336,17 +423,42 @@ uint32 cpu_read(uint32 addr)
     return 0;
 }
 
+// direct pointer to a 256-byte page for DMA, NULL for I/O
+uint8* cpu_page_ptr(uint32 addr)
+{
+    if (addr >= 0x8000 && addr <= 0xFFFF)
+    {
+        return prg_rom + map_addr(addr);
+    }
+    else if (addr <= 0x1FFF)
+    {
+        return ram + (addr & 0x0700);
+    }
+    else if (addr >= 0x6000 && addr <= 0x7FFF)
+    {
+        return prg_ram + (addr & 0x1F00);
+    }
+    return NULL;
+}
+
 void cpu_write(uint32 addr, uint8 data)
 {
     if (addr >= 0x8000 && addr <= 0xFFFF)
     {
         prg_rom[map_addr(addr)] = data;
+        FUSE_INVALIDATE(map_addr(addr));
     }
     else if (addr >= 0x0000 && addr <= 0x1FFF)
     {
         addr &= 0x07FF;
         ram[addr] = data;
     }
+    else if (addr >= 0x6000 && addr <= 0x7FFF)
+    {
+        addr &= 0x1FFF;
+        prg_ram[addr] = data;
+        prg_ram_dirty |= 1u << (addr >> 8);
+    }
     else if (addr >= 0x2000 && addr <= 0x3FFF)
     {
         addr &= 0x0007;
@@ -371,14 +483,30 @@ void cpu_nmi(void)
 
     PC = 0xFFFA;
     PC = MODE_ABS_ADDR();
+    PROF_CALL(PC);
+}
+
+void cpu_stall(uint32 cycles)
+{
+    cycles += (uint32)(cpu_cycles & 1);
+    cpu_cycles += cycles;
+    cpu_budget -= cycles;
+    PROF_STALL(cycles);
 }
 
 void cpu_clock(sint32 cycles)
 {
-    while (cycles--)
+    cpu_budget += cycles;
+    while (cpu_budget > 0)
     {
-        uint32 op = FETCH();
+        uint32 op;
+        FUSE_STEP();
+        TRACE_OP();
+        op = FETCH();
         ASSERT(op_table[op]);
+        PROF_OP(op);
+        cpu_cycles += op_cycles[op];
+        cpu_budget -= op_cycles[op];
         op_table[op]();
     }
 }
@@ -0,0 +1,623 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+// differential CPU test harness
+// - nestest.nes automation mode compared line by line against nestest.log
+// - per-opcode single-step JSON vectors (SingleStepTests / ProcessorTests nes6502 format) on a flat 64K bus
+
+uint32 cpu_read(uint32 addr);
+void cpu_write(uint32 addr, uint8 data);
+
+uint8 bus[0x10000];
+uint32 bus_flat;
+
+#define READ(ADDR)      (bus_flat ? bus[(ADDR) & 0xFFFF] : cpu_read(ADDR))
+#define WRITE(ADDR, V)  do { if (bus_flat) bus[(ADDR) & 0xFFFF] = (uint8)(V); else cpu_write(ADDR, V); } while (0)
+
+#include "nes.h"
+#include "timer.h"
+
+// B and U are not stored in the real P register, they only exist on the stack
+#define P_MASK          (0xFF & ~(P_B | P_U))
+
+#define STATE_RAM_MAX   64
+
+typedef struct
+{
+    uint32 pc, s, a, x, y, p;
+    uint32 ram_count;
+    uint32 ram[STATE_RAM_MAX][2];
+} STATE;
+
+typedef struct
+{
+    uint32 tests;
+    uint32 passed;
+    uint32 cycles;          // cycle count mismatches
+} OP_RESULT;
+
+OP_RESULT results[256];
+uint32 verbose;
+
+/* minimal JSON reader, just enough for the vector files */
+
+const char *json_ptr;
+const char *json_end;
+uint32 json_error;
+
+void json_ws(void)
+{
+    while (json_ptr < json_end && (*json_ptr == ' ' || *json_ptr == '\t' || *json_ptr == '\r' || *json_ptr == '\n'))
+    {
+        json_ptr++;
+    }
+}
+
+uint32 json_char(char c)
+{
+    json_ws();
+    if (json_ptr < json_end && *json_ptr == c)
+    {
+        json_ptr++;
+        return 1;
+    }
+    return 0;
+}
+
+void json_expect(char c)
+{
+    if (!json_char(c))
+    {
+        json_error = 1;
+        json_ptr = json_end;
+    }
+}
+
+// copies at most size-1 chars, escapes are kept as is
+void json_string(char *str, uint32 size)
+{
+    uint32 len = 0;
+
+    json_expect('"');
+    while (json_ptr < json_end && *json_ptr != '"')
+    {
+        if (*json_ptr == '\\' && json_ptr + 1 < json_end)
+        {
+            if (len + 1 < size)
+                str[len++] = *json_ptr;
+            json_ptr++;
+        }
+        if (len + 1 < size)
+            str[len++] = *json_ptr;
+        json_ptr++;
+    }
+    json_expect('"');
+
+    if (size)
+        str[len] = 0;
+}
+
+sint32 json_int(void)
+{
+    sint32 sign = 1, v = 0;
+
+    json_ws();
+    if (json_ptr < json_end && *json_ptr == '-')
+    {
+        sign = -1;
+        json_ptr++;
+    }
+    if (json_ptr >= json_end || *json_ptr < '0' || *json_ptr > '9')
+    {
+        json_error = 1;
+        json_ptr = json_end;
+        return 0;
+    }
+    while (json_ptr < json_end && *json_ptr >= '0' && *json_ptr <= '9')
+    {
+        v = v * 10 + (*json_ptr++ - '0');
+    }
+    return v * sign;
+}
+
+void json_skip(void)
+{
+    json_ws();
+    if (json_ptr >= json_end)
+    {
+        json_error = 1;
+        return;
+    }
+
+    if (*json_ptr == '"')
+    {
+        json_string(NULL, 0);
+    }
+    else if (*json_ptr == '{' || *json_ptr == '[')
+    {
+        char close = (*json_ptr++ == '{') ? '}' : ']';
+        if (json_char(close))
+            return;
+        do
+        {
+            if (close == '}')
+            {
+                json_string(NULL, 0);
+                json_expect(':');
+            }
+            json_skip();
+        } while (json_char(','));
+        json_expect(close);
+    }
+    else
+    {
+        while (json_ptr < json_end && !strchr(",]}", *json_ptr))
+        {
+            json_ptr++;
+        }
+    }
+}
+
+void json_state(STATE *state)
+{
+    char key[16];
+
+    memset(state, 0, sizeof(*state));
+    json_expect('{');
+    do
+    {
+        json_string(key, sizeof(key));
+        json_expect(':');
+
+        if (!strcmp(key, "pc"))
+            state->pc = json_int();
+        else if (!strcmp(key, "s"))
+            state->s = json_int();
+        else if (!strcmp(key, "a"))
+            state->a = json_int();
+        else if (!strcmp(key, "x"))
+            state->x = json_int();
+        else if (!strcmp(key, "y"))
+            state->y = json_int();
+        else if (!strcmp(key, "p"))
+            state->p = json_int();
+        else if (!strcmp(key, "ram"))
+        {
+            json_expect('[');
+            if (json_char(']'))
+                continue;
+            do
+            {
+                uint32 addr, data;
+                json_expect('[');
+                addr = json_int();
+                json_expect(',');
+                data = json_int();
+                json_expect(']');
+                if (state->ram_count < STATE_RAM_MAX)
+                {
+                    state->ram[state->ram_count][0] = addr & 0xFFFF;
+                    state->ram[state->ram_count][1] = data & 0xFF;
+                    state->ram_count++;
+                }
+            } while (json_char(','));
+            json_expect(']');
+        }
+        else
+            json_skip();
+    } while (json_char(','));
+    json_expect('}');
+}
+
+uint32 json_count(void)
+{
+    uint32 count = 0;
+    json_expect('[');
+    if (json_char(']'))
+        return 0;
+    do
+    {
+        json_skip();
+        count++;
+    } while (json_char(','));
+    json_expect(']');
+    return count;
+}
+
+/* single-step vectors */
+
+void state_print(const char *label, uint32 pc, uint32 a, uint32 x, uint32 y, uint32 p, uint32 s)
+{
+    printf("    %-8s PC:%04X A:%02X X:%02X Y:%02X P:%02X SP:%02X\n", label, pc, a, x, y, p, s);
+}
+
+// cycles the core doesn't charge (op_cycles is base cycles only): taken branches, branches
+// into another page and indexed reads crossing a page, predicted from the vector's own state
+uint32 vector_penalty(uint32 op, const STATE *init, const STATE *fin)
+{
+    uint32 pc = init->pc, base;
+
+    switch (op)
+    {
+        case 0x10 : case 0x30 : case 0x50 : case 0x70 :         // branches
+        case 0x90 : case 0xB0 : case 0xD0 : case 0xF0 :
+            pc = (pc + 2) & 0xFFFF;
+            if (fin->pc == pc)
+                return 0;
+            return ((fin->pc ^ pc) & 0xFF00) ? 2 : 1;
+
+        case 0x1D : case 0x3D : case 0x5D : case 0x7D :         // abs,X reads
+        case 0xBD : case 0xDD : case 0xFD : case 0xBC :
+            base = bus[(pc + 1) & 0xFFFF] | (bus[(pc + 2) & 0xFFFF] << 8);
+            return ((base & 0xFF) + init->x) > 0xFF;
+
+        case 0x19 : case 0x39 : case 0x59 : case 0x79 :         // abs,Y reads
+        case 0xB9 : case 0xD9 : case 0xF9 : case 0xBE :
+            base = bus[(pc + 1) & 0xFFFF] | (bus[(pc + 2) & 0xFFFF] << 8);
+            return ((base & 0xFF) + init->y) > 0xFF;
+
+        case 0x11 : case 0x31 : case 0x51 : case 0x71 :         // (zp),Y reads
+        case 0xB1 : case 0xD1 : case 0xF1 :
+            base = bus[(pc + 1) & 0xFFFF];
+            base = bus[base] | (bus[(base + 1) & 0xFF] << 8);
+            return ((base & 0xFF) + init->y) > 0xFF;
+    }
+    return 0;
+}
+
+// returns 1 if the final state matches
+uint32 vector_run(const char *name, const STATE *init, const STATE *fin, uint32 cycles)
+{
+    OP_RESULT *res;
+    uint32 op, i, ok, penalty = 0;
+
+    for (i = 0; i < init->ram_count; i++)
+    {
+        bus[init->ram[i][0]] = init->ram[i][1];
+    }
+
+    op = bus[init->pc];
+    res = results + op;
+    res->tests++;
+
+    PC = init->pc;
+    S = init->s;
+    A = init->a;
+    X = init->x;
+    Y = init->y;
+    P = init->p;
+
+    ok = 0;
+    if (op_table[op])
+    {
+        penalty = vector_penalty(op, init, fin);
+        cpu_cycles = 0;
+        cpu_budget = 0;
+        cpu_clock(1);
+
+        ok = (PC == fin->pc) && (S == fin->s) && (A == fin->a) && (X == fin->x) && (Y == fin->y) &&
+             ((P & P_MASK) == (fin->p & P_MASK));
+
+        for (i = 0; i < fin->ram_count; i++)
+        {
+            if (bus[fin->ram[i][0]] != fin->ram[i][1])
+                ok = 0;
+        }
+
+        // any other difference is a real timing regression and fails the vector
+        if (cpu_cycles + penalty != cycles)
+        {
+            res->cycles++;
+            ok = 0;
+        }
+    }
+
+    if (ok)
+    {
+        res->passed++;
+    }
+    else if (verbose && res->tests - res->passed == 1 && op_table[op])
+    {
+        printf("  %02X %s %s: \"%s\"\n", op, op_name[op], op_mode[op], name);
+        state_print("expected", fin->pc, fin->a, fin->x, fin->y, fin->p, fin->s);
+        state_print("got", PC, A, X, Y, P, S);
+        if (cpu_cycles + penalty != cycles)
+            printf("    cycles expected %u got %u (%llu base + %u penalty)\n", cycles, (uint32)cpu_cycles + penalty, cpu_cycles, penalty);
+        for (i = 0; i < fin->ram_count; i++)
+        {
+            uint32 addr = fin->ram[i][0];
+            if (bus[addr] != fin->ram[i][1])
+                printf("    [%04X] expected %02X got %02X\n", addr, fin->ram[i][1], bus[addr]);
+        }
+    }
+
+    // leave the bus clean for the next vector
+    for (i = 0; i < init->ram_count; i++)
+    {
+        bus[init->ram[i][0]] = 0;
+    }
+    for (i = 0; i < fin->ram_count; i++)
+    {
+        bus[fin->ram[i][0]] = 0;
+    }
+
+    return ok;
+}
+
+sint32 vector_file(const char *path)
+{
+    static STATE init, fin;
+    char *data, name[128], key[16];
+    long size;
+    FILE *f = fopen(path, "rb");
+
+    if (!f)
+        return 0;
+
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    data = (char*)malloc(size);
+    if (!data || fread(data, 1, size, f) != (size_t)size)
+    {
+        free(data);
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+
+    json_ptr = data;
+    json_end = data + size;
+    json_error = 0;
+    bus_flat = 1;
+
+    json_expect('[');
+    if (!json_char(']'))
+    {
+        do
+        {
+            uint32 cycles = 0;
+            name[0] = 0;
+            memset(&init, 0, sizeof(init));
+            memset(&fin, 0, sizeof(fin));
+
+            json_expect('{');
+            do
+            {
+                json_string(key, sizeof(key));
+                json_expect(':');
+
+                if (!strcmp(key, "name"))
+                    json_string(name, sizeof(name));
+                else if (!strcmp(key, "initial"))
+                    json_state(&init);
+                else if (!strcmp(key, "final"))
+                    json_state(&fin);
+                else if (!strcmp(key, "cycles"))
+                    cycles = json_count();
+                else
+                    json_skip();
+            } while (json_char(','));
+            json_expect('}');
+
+            if (json_error)
+                break;
+
+            vector_run(name, &init, &fin, cycles);
+        } while (json_char(','));
+        json_expect(']');
+    }
+
+    bus_flat = 0;
+    free(data);
+
+    if (json_error)
+    {
+        printf("%s: parse error at offset %u\n", path, (uint32)(json_ptr - data));
+        return 0;
+    }
+    return 1;
+}
+
+// prints per-opcode results, returns the number of failing opcodes
+uint32 vector_report(void)
+{
+    uint32 op, tests = 0, passed = 0, failed = 0, skipped = 0, cycles = 0;
+
+    printf("op  name mode     tests   passed  cyc-mismatch\n");
+    for (op = 0; op < 256; op++)
+    {
+        OP_RESULT *r = results + op;
+        if (!r->tests)
+            continue;
+
+        tests += r->tests;
+        passed += r->passed;
+        cycles += r->cycles;
+
+        if (!op_table[op])
+        {
+            skipped++;
+            continue;
+        }
+
+        if (r->passed != r->tests)
+            failed++;
+
+        if (r->passed != r->tests || r->cycles || verbose)
+        {
+            printf("%02X  %s  %s  %8u %8u %8u%s\n", op, op_name[op], op_mode[op], r->tests, r->passed, r->cycles,
+                (r->passed != r->tests) ? "  FAIL" : "");
+        }
+    }
+    printf("%u of %u vectors passed, %u opcodes failed, %u unimplemented opcodes skipped, %u cycle mismatches\n",
+        passed, tests, failed, skipped, cycles);
+
+    return failed;
+}
+
+/* nestest.nes in automation mode ($C000), compared against nestest.log */
+
+// fetches a "KEY:hex" field from a log line
+uint32 log_field(const char *line, const char *key, uint32 *value)
+{
+    const char *s = strstr(line, key);
+    if (!s)
+        return 0;
+    return sscanf(s + strlen(key), "%x", value) == 1;
+}
+
+uint32 log_dec(const char *line, const char *key, uint32 *value)
+{
+    const char *s = strstr(line, key);
+    if (!s)
+        return 0;
+    return sscanf(s + strlen(key), "%u", value) == 1;
+}
+
+// returns the number of register mismatches (0 or 1, stops at the first one)
+uint32 nestest(const char *rom, const char *log)
+{
+    char line[256];
+    uint32 n = 0, cyc_line = 0, errors = 0;
+    FILE *f;
+
+    if (!nes_load(rom))
+    {
+        printf("can't load %s\n", rom);
+        return 1;
+    }
+    nes_reset();
+
+    f = fopen(log, "r");
+    if (!f)
+    {
+        printf("can't open %s\n", log);
+        return 1;
+    }
+
+    PC = 0xC000;
+    P = 0x24;
+    S = 0xFD;
+    cpu_cycles = 7;
+
+    while (fgets(line, sizeof(line), f))
+    {
+        uint32 pc, a, x, y, p, s, cyc;
+
+        if (sscanf(line, "%4x", &pc) != 1 || !log_field(line, "A:", &a) || !log_field(line, "X:", &x) ||
+            !log_field(line, "Y:", &y) || !log_field(line, "P:", &p) || !log_field(line, "SP:", &s))
+            continue;
+
+        n++;
+
+        if (PC != pc || A != a || X != x || Y != y || (P & P_MASK) != (p & P_MASK) || S != s)
+        {
+            printf("nestest: mismatch at line %u\n  %s", n, line);
+            state_print("got", PC, A, X, Y, P, S);
+            errors++;
+            break;
+        }
+
+        if (!cyc_line && log_dec(line, "CYC:", &cyc) && cyc != (uint32)cpu_cycles)
+        {
+            cyc_line = n;
+            printf("nestest: first cycle mismatch at line %u, expected %u got %u\n", n, cyc, (uint32)cpu_cycles);
+        }
+
+        if (!op_table[cpu_read(PC)])
+        {
+            printf("nestest: stopped at unimplemented opcode %02X at line %u\n", cpu_read(PC), n);
+            break;
+        }
+
+        cpu_budget = 0;
+        cpu_clock(1);
+    }
+    fclose(f);
+
+    // automation mode leaves error codes for official and unofficial opcodes in $02 and $03
+    printf("nestest: %u lines matched, result $02=%02X $03=%02X\n", n - errors, ram[2], ram[3]);
+
+    return errors + (ram[2] != 0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *rom = NULL;
+    const char *log = NULL;
+    uint32 files = 0, errors = 0;
+    uint64 t = time_ns();
+    int i;
+
+    sram_enabled = 0;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-nestest") && i + 2 < argc)
+        {
+            rom = argv[++i];
+            log = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-dir") && i + 1 < argc)
+        {
+            // <dir>/00.json .. <dir>/ff.json, missing files are ignored
+            char path[1024];
+            uint32 op;
+            i++;
+            for (op = 0; op < 256; op++)
+            {
+                FILE *f;
+                sprintf(path, "%.1000s/%02x.json", argv[i], op);
+                if (!(f = fopen(path, "rb")))
+                    continue;
+                fclose(f);
+                if (!vector_file(path))
+                    errors++;
+                files++;
+            }
+        }
+        else if (!strcmp(argv[i], "-v"))
+        {
+            verbose = 1;
+        }
+        else if (argv[i][0] != '-')
+        {
+            if (!vector_file(argv[i]))
+            {
+                printf("can't read %s\n", argv[i]);
+                errors++;
+            }
+            files++;
+        }
+        else
+        {
+            printf("usage: %s [-v] [-nestest nestest.nes nestest.log] [-dir vectors] [vector.json ...]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    if (!rom && !files)
+    {
+        printf("usage: %s [-v] [-nestest nestest.nes nestest.log] [-dir vectors] [vector.json ...]\n", argv[0]);
+        return -1;
+    }
+
+    if (files)
+    {
+        errors += vector_report();
+    }
+
+    if (rom)
+    {
+        errors += nestest(rom, log);
+    }
+
+    printf("done in %.3f s\n", (time_ns() - t) / 1000000000.0);
+
+    return errors ? 1 : 0;
+}
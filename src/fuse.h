@@ -0,0 +1,234 @@
+#ifndef FUSE_H
+#define FUSE_H
+
+// superinstructions, build with FUSE defined
+// a decode pass over PRG ROM marks hot opcode pairs and triples, cpu_clock runs a marked sequence
+// with a single dispatch and only the flags that survive the whole sequence are computed
+
+#ifdef FUSE
+
+#include <stdio.h>
+
+#include "common.h"
+#include "cpu.h"
+
+#define FUSE_SPAN   8 // longest fused sequence in bytes, rounded up
+
+// skips an opcode byte that was already matched by the decode pass
+#define FUSE_OP()   PC++
+
+// name, opcodes (0 terminates pairs)
+#define FUSE_TABLE(E)\
+    E(LDA_ZP0_CMP_IMM_BNE, 0xA5, 0xC9, 0xD0)\
+    E(LDA_ZP0_CMP_IMM_BEQ, 0xA5, 0xC9, 0xF0)\
+    E(LDA_IMM_STA_ABS,     0xA9, 0x8D, 0)\
+    E(LDA_IMM_STA_ZP0,     0xA9, 0x85, 0)\
+    E(LDA_ZP0_STA_ZP0,     0xA5, 0x85, 0)\
+    E(CMP_IMM_BNE,         0xC9, 0xD0, 0)\
+    E(CMP_IMM_BEQ,         0xC9, 0xF0, 0)\
+    E(DEX_BNE,             0xCA, 0xD0, 0)\
+    E(DEY_BNE,             0x88, 0xD0, 0)\
+    E(LDA_ABS_BPL,         0xAD, 0x10, 0)\
+    E(INC_ZP0_LDA_ZP0,     0xE6, 0xA5, 0)
+
+// LDA's Z/N are fully replaced by CMP
+void FUSE_LDA_ZP0_CMP_IMM_BNE(void)
+{
+    A = MODE_ZP0();
+    FUSE_OP();
+    { OP_CMP(MODE_IMM); }
+    FUSE_OP();
+    { OP_BNE(MODE_REL); }
+}
+
+void FUSE_LDA_ZP0_CMP_IMM_BEQ(void)
+{
+    A = MODE_ZP0();
+    FUSE_OP();
+    { OP_CMP(MODE_IMM); }
+    FUSE_OP();
+    { OP_BEQ(MODE_REL); }
+}
+
+void FUSE_LDA_IMM_STA_ABS(void)
+{
+    OP_LDA(MODE_IMM);
+    FUSE_OP();
+    OP_STA(MODE_ABS);
+}
+
+void FUSE_LDA_IMM_STA_ZP0(void)
+{
+    OP_LDA(MODE_IMM);
+    FUSE_OP();
+    OP_STA(MODE_ZP0);
+}
+
+void FUSE_LDA_ZP0_STA_ZP0(void)
+{
+    OP_LDA(MODE_ZP0);
+    FUSE_OP();
+    OP_STA(MODE_ZP0);
+}
+
+void FUSE_CMP_IMM_BNE(void)
+{
+    { OP_CMP(MODE_IMM); }
+    FUSE_OP();
+    { OP_BNE(MODE_REL); }
+}
+
+void FUSE_CMP_IMM_BEQ(void)
+{
+    { OP_CMP(MODE_IMM); }
+    FUSE_OP();
+    { OP_BEQ(MODE_REL); }
+}
+
+void FUSE_DEX_BNE(void)
+{
+    sint32 t;
+    X = (X - 1) & 0xFF;
+    SET_ZN(X);
+    FUSE_OP();
+    t = MODE_REL();
+    if (X)
+        PC += t;
+}
+
+void FUSE_DEY_BNE(void)
+{
+    sint32 t;
+    Y = (Y - 1) & 0xFF;
+    SET_ZN(Y);
+    FUSE_OP();
+    t = MODE_REL();
+    if (Y)
+        PC += t;
+}
+
+// the $2002 polling loop
+void FUSE_LDA_ABS_BPL(void)
+{
+    sint32 t;
+    A = MODE_ABS();
+    SET_ZN(A);
+    FUSE_OP();
+    t = MODE_REL();
+    if (!(A & 0x80))
+        PC += t;
+}
+
+// INC's Z/N are fully replaced by LDA
+void FUSE_INC_ZP0_LDA_ZP0(void)
+{
+    uint32 addr = MODE_ZP0_ADDR();
+    uint32 t = (READ(addr) + 1) & 0xFF;
+    WRITE(addr, t);
+    FUSE_OP();
+    OP_LDA(MODE_ZP0);
+}
+
+#define FUSE_ID(n, a, b, c) FUSE_ID_##n,
+#define FUSE_DECL(n, a, b, c) FUSE_##n,
+#define FUSE_NAME(n, a, b, c) #n,
+#define FUSE_OPS(n, a, b, c) { a, b, c },
+
+enum { FUSE_NONE, FUSE_TABLE(FUSE_ID) FUSE_COUNT };
+
+static const op_func fuse_table[FUSE_COUNT] = { NULL, FUSE_TABLE(FUSE_DECL) };
+const char *fuse_name[FUSE_COUNT] = { "", FUSE_TABLE(FUSE_NAME) };
+static const uint8 fuse_ops[FUSE_COUNT][3] = { { 0, 0, 0 }, FUSE_TABLE(FUSE_OPS) };
+
+uint8 fuse_cycles[FUSE_COUNT];      // whole sequence
+uint8 fuse_prefix[FUSE_COUNT];      // all but the last instruction
+uint64 fuse_hits[FUSE_COUNT];
+uint32 fuse_enabled = 1;
+
+// id of the sequence starting at offset, longer ones first
+static uint32 fuse_match(uint32 offset, uint32 size)
+{
+    uint32 id;
+
+    for (id = 1; id < FUSE_COUNT; id++)
+    {
+        const uint8 *ops = fuse_ops[id];
+        uint32 pos = offset, i;
+
+        for (i = 0; i < 3 && ops[i]; i++)
+        {
+            if (pos >= size || prg_rom[pos] != ops[i])
+                break;
+            pos += op_len[ops[i]];
+        }
+
+        if ((i == 3 || !ops[i]) && pos <= size)
+            return id;
+    }
+    return FUSE_NONE;
+}
+
+// decode pass over the mapped PRG ROM, every offset is a potential instruction start
+void fuse_build(void)
+{
+    uint32 size = (prg_banks > 1) ? 0x8000 : 0x4000;
+    uint32 id, i;
+
+    for (id = 1; id < FUSE_COUNT; id++)
+    {
+        fuse_cycles[id] = fuse_prefix[id] = 0;
+        for (i = 0; i < 3 && fuse_ops[id][i]; i++)
+        {
+            fuse_prefix[id] = fuse_cycles[id];
+            fuse_cycles[id] += op_cycles[fuse_ops[id][i]];
+        }
+    }
+
+    memset(fuse_map, 0, sizeof(fuse_map));
+    for (i = 0; i < size; i++)
+    {
+        fuse_map[i] = fuse_match(i, size);
+    }
+}
+
+// a write into PRG ROM drops every sequence that may cover the byte
+void fuse_invalidate(uint32 offset)
+{
+    uint32 i = (offset >= FUSE_SPAN - 1) ? offset - (FUSE_SPAN - 1) : 0;
+    for (; i <= offset; i++)
+    {
+        fuse_map[i] = FUSE_NONE;
+    }
+}
+
+// called by cpu_clock when the byte at PC starts a fused sequence
+uint32 fuse_step(void)
+{
+    uint32 id = fuse_map[map_addr(PC)];
+
+    // the unfused loop would stop before the last instruction once the budget runs out
+    if (!fuse_enabled || cpu_budget <= fuse_prefix[id])
+        return 0;
+
+    fuse_hits[id]++;
+    cpu_cycles += fuse_cycles[id];
+    cpu_budget -= fuse_cycles[id];
+
+    FUSE_OP();
+    fuse_table[id]();
+    return 1;
+}
+
+void fuse_report(FILE *f)
+{
+    uint32 id;
+    for (id = 1; id < FUSE_COUNT; id++)
+    {
+        if (fuse_hits[id])
+            fprintf(f, "fuse %-22s %12llu\n", fuse_name[id], fuse_hits[id]);
+    }
+}
+
+#endif
+
+#endif
@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nes.h"
+#include "video.h"
+#include "scale.h"
+#include "timer.h"
+#include "capture.h"
+#include "mem.h"
+
+uint8 SCREEN_LIST[FRAME_WIDTH * FRAME_HEIGHT];
+
+// the 32-bit frames are only needed here, so they don't count against the memory budget
+void bench_scale(uint32 count)
+{
+    uint32 *FRAME = (uint32*)malloc(FRAME_WIDTH * FRAME_HEIGHT * 4);
+    uint32 *SCALED = (uint32*)malloc(FRAME_WIDTH * FRAME_HEIGHT * 9 * 4);
+    uint32 scaler, simd, i;
+
+    if (!FRAME || !SCALED)
+    {
+        printf("bench_scale: out of memory\n");
+        free(FRAME);
+        free(SCALED);
+        return;
+    }
+
+    video_update(VIDEO_ARGB8888, 0);
+    video_convert(FRAME, SCREEN, FRAME_WIDTH * FRAME_HEIGHT);
+
+    for (simd = 0; simd < 2; simd++)
+    {
+        scale_simd = simd;
+        for (scaler = 0; scaler < SCALE_COUNT; scaler++)
+        {
+            uint32 pitch = FRAME_WIDTH * scale_factor[scaler] * 4;
+            uint64 t = time_ns();
+            for (i = 0; i < count; i++)
+            {
+                scale_frame(scaler, SCALED, pitch, FRAME, 4);
+            }
+            t = time_ns() - t;
+            printf("scale %-10s %-6s %10.0f ns/frame\n", scale_name[scaler], simd ? "simd" : "scalar", (double)t / count);
+        }
+    }
+    scale_simd = 1;
+
+    free(FRAME);
+    free(SCALED);
+}
+
+int main(int argc, char **argv)
+{
+    const char *rom = NULL;
+    uint32 frames = 600;
+    uint32 check = 0;
+    uint32 bench = 0;
+    uint32 frame = 0;
+    uint32 check_render = 0;
+    uint32 render_errors = 0;
+    const char *profile = NULL;
+    const char *perf = NULL;
+    const char *trace = NULL;
+    uint32 trace_last = 0;
+    const char *movie = NULL;
+    const char *hash = NULL;
+    FILE *hash_file = NULL;
+    uint8 joy_live[2] = { 0, 0 };
+    const char *index = NULL;
+    const char *index_filter = NULL;
+    uint32 index_build = 0;
+    const char **roms = (const char**)malloc(argc * sizeof(char*));
+    uint32 rom_count = 0;
+    const char *capture = NULL;
+    uint32 capture_fmt = CAPTURE_Y4M;
+    uint32 capture_only_changed = 0;
+    const PPU_TIER *tier = NULL;
+    const char *tier_db = NULL;
+    uint64 t;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-frames") && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-check"))
+            check = 1;
+        else if (!strcmp(argv[i], "-check-render"))
+            check_render = 1;
+        else if (!strcmp(argv[i], "-profile") && i + 1 < argc)
+            profile = argv[++i];
+        else if (!strcmp(argv[i], "-perf") && i + 1 < argc)
+            perf = argv[++i];
+        else if (!strcmp(argv[i], "-trace") && i + 1 < argc)
+            trace = argv[++i];
+        else if (!strcmp(argv[i], "-trace-last") && i + 1 < argc)
+            trace_last = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-movie") && i + 1 < argc)
+            movie = argv[++i];
+        else if (!strcmp(argv[i], "-hash") && i + 1 < argc)
+            hash = argv[++i];
+        else if (!strcmp(argv[i], "-no-fuse"))
+        {
+        #ifdef FUSE
+            fuse_enabled = 0;
+        #endif
+        }
+        else if (!strcmp(argv[i], "-no-sav"))
+            sram_enabled = 0;
+        else if (!strcmp(argv[i], "-render-list"))
+            render_mode = RENDER_MODE_LIST;
+        else if (!strcmp(argv[i], "-bench-scale") && i + 1 < argc)
+            bench = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-tier") && i + 1 < argc)
+        {
+            if (!(tier = nes_tier_find(argv[++i])))
+            {
+                printf("unknown tier %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (!strcmp(argv[i], "-tier-db") && i + 1 < argc)
+            tier_db = argv[++i];
+        else if (!strcmp(argv[i], "-capture") && i + 1 < argc)
+            capture = argv[++i];
+        else if (!strcmp(argv[i], "-capture-format") && i + 1 < argc)
+        {
+            i++;
+            capture_fmt = !strcmp(argv[i], "rgb") ? CAPTURE_RGB : (!strcmp(argv[i], "indexed") ? CAPTURE_INDEXED : CAPTURE_Y4M);
+        }
+        else if (!strcmp(argv[i], "-capture-changed"))
+            capture_only_changed = 1;
+        else if (!strcmp(argv[i], "-index") && i + 1 < argc)
+            index = argv[++i];
+        else if (!strcmp(argv[i], "-index-build"))
+            index_build = 1;
+        else if (!strcmp(argv[i], "-index-filter") && i + 1 < argc)
+            index_filter = argv[++i];
+        else
+            rom = roms[rom_count++] = argv[i];
+    }
+
+    // index mode: build from the given ROMs and/or print the paths matching a filter
+    if (index)
+    {
+        if (index_build)
+        {
+            sint32 count = library_build(index, roms, rom_count);
+            if (count < 0)
+            {
+                printf("can't write %s\n", index);
+                return -1;
+            }
+            printf("%d of %u roms indexed\n", count, rom_count);
+        }
+        if ((index_filter || !index_build) && library_filter(index, index_filter, stdout) < 0)
+        {
+            printf("can't read %s\n", index);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (check)
+    {
+        uint32 v = video_check();
+        uint32 s = scale_check();
+        printf("video_check: %u mismatches\n", v);
+        printf("scale_check: %u mismatches\n", s);
+        if (v || s)
+            return 1;
+    }
+
+    if (!rom)
+    {
+        if (check)
+            return 0;
+        printf("usage: %s <rom.nes[.gz]|rom.zip> [-frames N] [-check] [-check-render] [-render-list] [-profile prefix] [-perf file.csv] [-trace file.log [-trace-last N]] [-movie file.nesm] [-hash file.txt] [-no-sav] [-no-fuse] [-tier fast|dot] [-tier-db file] [-bench-scale N]\n"
+               "       [-capture file|- [-capture-format y4m|rgb|indexed] [-capture-changed]]\n"
+               "       %s -index file.idx -index-build <roms...>\n"
+               "       %s -index file.idx [-index-filter mapper=0,prg<=2,battery=1]\n", argv[0], argv[0], argv[0]);
+        return -1;
+    }
+
+    // replays start from blank PRG-RAM, a .sav file would break determinism
+    if (movie)
+    {
+        sram_enabled = 0;
+    }
+
+    if (!nes_load(rom))
+    {
+        printf("can't load %s\n", rom);
+        return -1;
+    }
+
+    nes_reset();
+
+    ppu_tier = tier ? tier : nes_tier_select(tier_db);
+
+    // the display list is built by the tile renderer only
+    if (ppu_tier == &ppu_tier_dot && (check_render || (render_mode & RENDER_MODE_LIST)))
+    {
+        printf("-check-render and -render-list need the fast tier\n");
+        return -1;
+    }
+
+    if (movie && !movie_replay(movie))
+    {
+        printf("can't replay %s\n", movie);
+        return -1;
+    }
+
+    if (hash && !(hash_file = fopen(hash, "w")))
+    {
+        printf("can't write %s\n", hash);
+        return -1;
+    }
+
+    if (capture && !capture_open(capture, capture_fmt, capture_only_changed))
+    {
+        printf("can't write %s\n", capture);
+        return -1;
+    }
+
+    // after capture_open, which moves text output off stdout when streaming
+    printf("tier: %s\n", ppu_tier->name);
+
+    mem_report(stdout);
+    mem_line(stdout, "frontend", sizeof(SCREEN_LIST));
+    if (capture)
+    {
+        mem_line(stdout, "capture", sizeof(capture_slot));
+    }
+    mem_end(stdout);
+
+    movie_input(joy_live);
+
+    render_backend = &render_soft;
+    if (check_render)
+    {
+        // direct path into SCREEN, display list rasterized into SCREEN_LIST
+        render_mode = RENDER_MODE_DIRECT | RENDER_MODE_LIST;
+        render_soft_target = SCREEN_LIST;
+    }
+
+    t = time_ns();
+    while (frame < frames)
+    {
+        if (nes_scanline())
+        {
+            if (check_render && memcmp(SCREEN, SCREEN_LIST, sizeof(SCREEN)))
+            {
+                render_errors++;
+            }
+            PERF_FRAME();
+            capture_frame(SCREEN);
+            if (hash_file)
+            {
+                fprintf(hash_file, "%u %016llx\n", frame, movie_hash());
+            }
+            movie_input(joy_live);
+            frame++;
+        }
+    }
+    t = time_ns() - t;
+
+    if (capture)
+    {
+        capture_close();
+        printf("capture: %u frames, %u written\n", capture_frames, capture_written);
+    }
+
+    if (hash_file)
+    {
+        fclose(hash_file);
+    }
+    movie_close();
+    nes_close();
+
+    if (check_render)
+    {
+        printf("render_check: %u of %u frames differ\n", render_errors, frames);
+    }
+
+    printf("%u frames in %.3f ms (%.1f fps)\n", frames, t / 1000000.0, frames * 1000000000.0 / (double)(t ? t : 1));
+    printf("final hash %016llx\n", movie_hash());
+
+    if (profile)
+    {
+    #ifdef PROFILE
+        if (!prof_dump(profile))
+            printf("can't write profile %s\n", profile);
+    #else
+        printf("profile: build with -DPROFILE\n");
+    #endif
+    }
+
+    if (trace)
+    {
+    #ifdef TRACE
+        if (!trace_dump(trace, trace_last))
+            printf("can't write %s\n", trace);
+    #else
+        (void)trace_last;
+        printf("trace: build with -DTRACE\n");
+    #endif
+    }
+
+#ifdef FUSE
+    fuse_report(stdout);
+#endif
+
+    if (perf)
+    {
+    #ifdef PERF
+        perf_summary(stdout);
+        if (!perf_dump(perf))
+            printf("can't write %s\n", perf);
+    #else
+        printf("perf: build with -DPERF\n");
+    #endif
+    }
+
+    if (bench)
+    {
+        bench_scale(bench);
+    }
+
+    return render_errors ? 1 : 0;
+}
@@ -0,0 +1,449 @@
+#ifndef INFLATE_H
+#define INFLATE_H
+
+// streaming deflate decoder (RFC 1951) with a 32 KB window and CRC32
+// input is pulled from a FILE, output is pushed to a sink every time the window wraps
+
+#include <stdio.h>
+
+#include "common.h"
+
+/* CRC32 (IEEE, reflected) */
+
+uint32 crc32_table[256];
+
+uint32 crc32_update(uint32 crc, const uint8 *data, uint32 size)
+{
+    if (!crc32_table[1])
+    {
+        uint32 i, j;
+        for (i = 0; i < 256; i++)
+        {
+            uint32 c = i;
+            for (j = 0; j < 8; j++)
+            {
+                c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+            }
+            crc32_table[i] = c;
+        }
+    }
+
+    crc = ~crc;
+    while (size--)
+    {
+        crc = crc32_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/* inflate */
+
+#define INFLATE_WINDOW      (32 * 1024)
+#define INFLATE_FAST_BITS   9
+
+typedef void (*inflate_sink)(void *ctx, const uint8 *data, uint32 size);
+
+typedef struct
+{
+    uint16 fast[1 << INFLATE_FAST_BITS];    // symbol | (length << 12), 0 if the code is longer
+    uint16 count[16];                       // codes per length
+    uint16 symbol[288];                     // symbols ordered by code
+} HUFFMAN;
+
+typedef struct
+{
+    FILE *f;
+    uint8 in[4096];
+    uint32 in_pos;
+    uint32 in_size;
+    uint32 in_pad;                  // zero bytes fed past the end of the file
+
+    uint32 bits;
+    uint32 bit_count;
+
+    uint8 window[INFLATE_WINDOW];
+    uint32 out_pos;                 // total bytes produced
+    uint32 out_flushed;
+
+    inflate_sink sink;
+    void *ctx;
+
+    uint32 error;
+} INFLATE;
+
+static const uint16 inflate_len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const uint8 inflate_len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const uint16 inflate_dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+static const uint8 inflate_dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static const uint8 inflate_clen_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+void inflate_init(INFLATE *s, FILE *f, inflate_sink sink, void *ctx)
+{
+    s->f = f;
+    s->in_pos = s->in_size = s->in_pad = 0;
+    s->bits = s->bit_count = 0;
+    s->out_pos = s->out_flushed = 0;
+    s->sink = sink;
+    s->ctx = ctx;
+    s->error = 0;
+}
+
+static uint32 inflate_byte(INFLATE *s)
+{
+    if (s->in_pos == s->in_size)
+    {
+        s->in_pos = 0;
+        s->in_size = (uint32)fread(s->in, 1, sizeof(s->in), s->f);
+        if (!s->in_size)
+        {
+            // pad so the fast path can peek past the end, running out for real is an error
+            if (++s->in_pad > 4)
+                s->error = 1;
+            return 0;
+        }
+    }
+    return s->in[s->in_pos++];
+}
+
+static void inflate_fill(INFLATE *s, uint32 count)
+{
+    while (s->bit_count < count)
+    {
+        s->bits |= inflate_byte(s) << s->bit_count;
+        s->bit_count += 8;
+    }
+}
+
+static uint32 inflate_bits(INFLATE *s, uint32 count)
+{
+    uint32 v;
+    if (!count)
+        return 0;
+    inflate_fill(s, count);
+    v = s->bits & ((1u << count) - 1);
+    s->bits >>= count;
+    s->bit_count -= count;
+    return v;
+}
+
+// drops the bits up to the next byte boundary, used by stored blocks and container trailers
+void inflate_align(INFLATE *s)
+{
+    s->bits >>= s->bit_count & 7;
+    s->bit_count &= ~7;
+}
+
+uint32 inflate_u32(INFLATE *s)
+{
+    uint32 lo = inflate_bits(s, 16);
+    return lo | (inflate_bits(s, 16) << 16);
+}
+
+static void inflate_flush(INFLATE *s)
+{
+    uint32 size = s->out_pos - s->out_flushed;
+    if (size)
+    {
+        s->sink(s->ctx, s->window + (s->out_flushed & (INFLATE_WINDOW - 1)), size);
+        s->out_flushed = s->out_pos;
+    }
+}
+
+static void inflate_out(INFLATE *s, uint32 value)
+{
+    s->window[s->out_pos++ & (INFLATE_WINDOW - 1)] = (uint8)value;
+    if (!(s->out_pos & (INFLATE_WINDOW - 1)))
+    {
+        inflate_flush(s);
+    }
+}
+
+static uint32 inflate_build(HUFFMAN *h, const uint8 *lengths, uint32 count)
+{
+    uint16 offs[16];
+    uint32 i, len, code, left;
+
+    memset(h->count, 0, sizeof(h->count));
+    memset(h->fast, 0, sizeof(h->fast));
+
+    for (i = 0; i < count; i++)
+    {
+        h->count[lengths[i]]++;
+    }
+    h->count[0] = 0;
+
+    // over-subscribed sets are invalid, incomplete ones are allowed
+    left = 1;
+    for (len = 1; len < 16; len++)
+    {
+        left <<= 1;
+        if (left < h->count[len])
+            return 0;
+        left -= h->count[len];
+    }
+
+    offs[1] = 0;
+    for (len = 1; len < 15; len++)
+    {
+        offs[len + 1] = offs[len] + h->count[len];
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (lengths[i])
+            h->symbol[offs[lengths[i]]++] = i;
+    }
+
+    // fast table indexed by the next INFLATE_FAST_BITS input bits (codes are stored bit-reversed)
+    code = 0;
+    i = 0;
+    for (len = 1; len <= INFLATE_FAST_BITS; len++)
+    {
+        uint32 n;
+        for (n = 0; n < h->count[len]; n++, i++, code++)
+        {
+            uint32 rev = 0, b, j;
+            for (b = 0; b < len; b++)
+            {
+                rev |= ((code >> b) & 1) << (len - 1 - b);
+            }
+            for (j = rev; j < (1 << INFLATE_FAST_BITS); j += 1 << len)
+            {
+                h->fast[j] = h->symbol[i] | (len << 12);
+            }
+        }
+        code <<= 1;
+    }
+
+    return 1;
+}
+
+static uint32 inflate_decode(INFLATE *s, const HUFFMAN *h)
+{
+    uint32 code, first, index, len;
+    uint32 e;
+
+    inflate_fill(s, INFLATE_FAST_BITS);
+    e = h->fast[s->bits & ((1 << INFLATE_FAST_BITS) - 1)];
+    if (e)
+    {
+        s->bits >>= e >> 12;
+        s->bit_count -= e >> 12;
+        return e & 0x0FFF;
+    }
+
+    // canonical decode bit by bit for the long codes
+    code = first = index = 0;
+    for (len = 1; len < 16; len++)
+    {
+        uint32 count = h->count[len];
+        code |= inflate_bits(s, 1);
+        if (code - first < count)
+            return h->symbol[index + (code - first)];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+
+    s->error = 1;
+    return 0;
+}
+
+static void inflate_codes(INFLATE *s, const HUFFMAN *lit, const HUFFMAN *dist)
+{
+    while (!s->error)
+    {
+        uint32 sym = inflate_decode(s, lit);
+
+        if (sym < 256)
+        {
+            inflate_out(s, sym);
+        }
+        else if (sym == 256)
+        {
+            return;
+        }
+        else
+        {
+            uint32 len, d;
+
+            sym -= 257;
+            if (sym >= 29)
+            {
+                s->error = 1;
+                return;
+            }
+            len = inflate_len_base[sym] + inflate_bits(s, inflate_len_extra[sym]);
+
+            sym = inflate_decode(s, dist);
+            if (sym >= 30)
+            {
+                s->error = 1;
+                return;
+            }
+            d = inflate_dist_base[sym] + inflate_bits(s, inflate_dist_extra[sym]);
+            if (d > s->out_pos)
+            {
+                s->error = 1;
+                return;
+            }
+
+            while (len--)
+            {
+                inflate_out(s, s->window[(s->out_pos - d) & (INFLATE_WINDOW - 1)]);
+            }
+        }
+    }
+}
+
+static void inflate_stored(INFLATE *s)
+{
+    uint32 len, nlen;
+
+    inflate_align(s);
+    len = inflate_bits(s, 16);
+    nlen = inflate_bits(s, 16);
+    if (len != (~nlen & 0xFFFF))
+    {
+        s->error = 1;
+        return;
+    }
+
+    while (len-- && !s->error)
+    {
+        inflate_out(s, inflate_bits(s, 8));
+    }
+}
+
+static void inflate_fixed(INFLATE *s)
+{
+    static HUFFMAN lit, dist;
+    static uint32 ready;
+
+    if (!ready)
+    {
+        uint8 lengths[288];
+        uint32 i;
+        for (i = 0; i < 144; i++) lengths[i] = 8;
+        for (; i < 256; i++) lengths[i] = 9;
+        for (; i < 280; i++) lengths[i] = 7;
+        for (; i < 288; i++) lengths[i] = 8;
+        inflate_build(&lit, lengths, 288);
+
+        for (i = 0; i < 30; i++) lengths[i] = 5;
+        inflate_build(&dist, lengths, 30);
+        ready = 1;
+    }
+
+    inflate_codes(s, &lit, &dist);
+}
+
+static void inflate_dynamic(INFLATE *s)
+{
+    static HUFFMAN lit, dist;
+    uint8 lengths[288 + 32];
+    uint32 nlen, ndist, ncode, i;
+
+    nlen = inflate_bits(s, 5) + 257;
+    ndist = inflate_bits(s, 5) + 1;
+    ncode = inflate_bits(s, 4) + 4;
+    if (nlen > 286 || ndist > 30)
+    {
+        s->error = 1;
+        return;
+    }
+
+    memset(lengths, 0, 19);
+    for (i = 0; i < ncode; i++)
+    {
+        lengths[inflate_clen_order[i]] = inflate_bits(s, 3);
+    }
+    if (!inflate_build(&lit, lengths, 19))
+    {
+        s->error = 1;
+        return;
+    }
+
+    for (i = 0; i < nlen + ndist && !s->error;)
+    {
+        uint32 sym = inflate_decode(s, &lit);
+        uint32 len = 0, rep;
+
+        if (sym < 16)
+        {
+            lengths[i++] = sym;
+            continue;
+        }
+
+        if (sym == 16)
+        {
+            if (!i)
+            {
+                s->error = 1;
+                return;
+            }
+            len = lengths[i - 1];
+            rep = 3 + inflate_bits(s, 2);
+        }
+        else if (sym == 17)
+            rep = 3 + inflate_bits(s, 3);
+        else
+            rep = 11 + inflate_bits(s, 7);
+
+        if (i + rep > nlen + ndist)
+        {
+            s->error = 1;
+            return;
+        }
+        while (rep--)
+        {
+            lengths[i++] = len;
+        }
+    }
+
+    if (s->error || !lengths[256] || !inflate_build(&lit, lengths, nlen) || !inflate_build(&dist, lengths + nlen, ndist))
+    {
+        s->error = 1;
+        return;
+    }
+
+    inflate_codes(s, &lit, &dist);
+}
+
+// decodes one deflate stream, returns the number of bytes produced or -1 on error
+sint32 inflate_run(INFLATE *s)
+{
+    uint32 last;
+
+    do
+    {
+        last = inflate_bits(s, 1);
+        switch (inflate_bits(s, 2))
+        {
+            case 0 : inflate_stored(s); break;
+            case 1 : inflate_fixed(s); break;
+            case 2 : inflate_dynamic(s); break;
+            default : s->error = 1;
+        }
+    } while (!last && !s->error);
+
+    inflate_flush(s);
+
+    return s->error ? -1 : (sint32)s->out_pos;
+}
+
+#endif
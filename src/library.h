@@ -0,0 +1,177 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+// on-disk text index of ROM headers and CRC32, one line per ROM:
+// <crc32> <mapper> <prg 16K banks> <chr 8K banks> <flags6> <flags7> <path>
+// lets batch runs filter thousands of compressed ROMs without opening them
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "cart.h"
+#include "archive.h"
+
+#define LIBRARY_MAGIC   "# nes-3do rom index v1"
+
+typedef struct
+{
+    uint32 crc;
+    uint32 mapper;
+    uint32 prg_banks;
+    uint32 chr_banks;
+    uint32 flags6;
+    uint32 flags7;
+    char path[1024];
+} LIBRARY_ENTRY;
+
+// decodes the ROM once without touching the cart storage
+sint32 library_probe(const char *path, LIBRARY_ENTRY *e)
+{
+    CART_STREAM s;
+
+    cart_stream_begin(&s, 0);
+    if (!archive_load(path, cart_stream_sink, &s) || !cart_stream_end(&s))
+        return 0;
+
+    e->crc = s.crc;
+    e->mapper = (s.header.flags7 & 0xF0) | (s.header.flags6 >> 4);
+    e->prg_banks = s.header.prg_banks;
+    e->chr_banks = s.header.chr_banks;
+    e->flags6 = s.header.flags6;
+    e->flags7 = s.header.flags7;
+    snprintf(e->path, sizeof(e->path), "%s", path);
+    return 1;
+}
+
+// returns the number of entries written, unreadable ROMs are reported and skipped
+sint32 library_build(const char *index, const char **files, uint32 count)
+{
+    LIBRARY_ENTRY e;
+    uint32 i, written = 0;
+    FILE *f = fopen(index, "w");
+
+    if (!f)
+        return -1;
+
+    fprintf(f, "%s\n", LIBRARY_MAGIC);
+    for (i = 0; i < count; i++)
+    {
+        if (!library_probe(files[i], &e))
+        {
+            printf("can't read %s\n", files[i]);
+            continue;
+        }
+        fprintf(f, "%08X %u %u %u %02X %02X %s\n", e.crc, e.mapper, e.prg_banks, e.chr_banks, e.flags6, e.flags7, e.path);
+        written++;
+    }
+
+    fclose(f);
+    return written;
+}
+
+// next entry, skips comments and malformed lines
+sint32 library_read(FILE *f, LIBRARY_ENTRY *e)
+{
+    char line[1280];
+
+    while (fgets(line, sizeof(line), f))
+    {
+        sint32 n = 0;
+        uint32 len;
+
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%x %u %u %u %x %x %n", &e->crc, &e->mapper, &e->prg_banks, &e->chr_banks, &e->flags6, &e->flags7, &n) != 6 || !n)
+            continue;
+
+        snprintf(e->path, sizeof(e->path), "%s", line + n);
+        len = (uint32)strlen(e->path);
+        while (len && (e->path[len - 1] == '\n' || e->path[len - 1] == '\r'))
+        {
+            e->path[--len] = 0;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+static uint32 library_field(const LIBRARY_ENTRY *e, const char *key, uint32 *value)
+{
+    if (!strcmp(key, "crc"))
+        *value = e->crc;
+    else if (!strcmp(key, "mapper"))
+        *value = e->mapper;
+    else if (!strcmp(key, "prg"))
+        *value = e->prg_banks;
+    else if (!strcmp(key, "chr"))
+        *value = e->chr_banks;
+    else if (!strcmp(key, "battery"))
+        *value = (e->flags6 & CART_BATTERY) ? 1 : 0;
+    else if (!strcmp(key, "trainer"))
+        *value = (e->flags6 & CART_TRAINER) ? 1 : 0;
+    else if (!strcmp(key, "mirror"))
+        *value = (e->flags6 & CART_FOUR_SCREEN) ? TBL_MIRROR_4 : (e->flags6 & 1);
+    else
+        return 0;
+    return 1;
+}
+
+// filter is a comma separated list of <key><op><value>, e.g. "mapper=0,prg<=2,battery=1"
+// keys: crc mapper prg chr battery trainer mirror, ops: = != < > <= >=
+uint32 library_match(const LIBRARY_ENTRY *e, const char *filter)
+{
+    while (filter && *filter)
+    {
+        char key[16], op[3];
+        uint32 field, value;
+        sint32 n = 0;
+
+        if (sscanf(filter, " %15[a-z] %2[!<>=] %n", key, op, &n) != 2 || !n || !library_field(e, key, &field))
+            return 0;
+
+        // crc is written as bare hex in the index, so it's parsed the same way here
+        value = (uint32)strtoul(filter + n, NULL, strcmp(key, "crc") ? 0 : 16);
+
+        if (strcmp(op, "=") && strcmp(op, "!=") && strcmp(op, "<") && strcmp(op, ">") && strcmp(op, "<=") && strcmp(op, ">="))
+            return 0;
+
+        if ((!strcmp(op, "=") && field != value) ||
+            (!strcmp(op, "!=") && field == value) ||
+            (!strcmp(op, "<") && field >= value) ||
+            (!strcmp(op, ">") && field <= value) ||
+            (!strcmp(op, "<=") && field > value) ||
+            (!strcmp(op, ">=") && field < value))
+            return 0;
+
+        filter = strchr(filter, ',');
+        if (filter)
+            filter++;
+    }
+    return 1;
+}
+
+// prints the paths of all matching entries, returns their count or -1 if the index can't be read
+sint32 library_filter(const char *index, const char *filter, FILE *out)
+{
+    LIBRARY_ENTRY e;
+    sint32 count = 0;
+    FILE *f = fopen(index, "r");
+
+    if (!f)
+        return -1;
+
+    while (library_read(f, &e))
+    {
+        if (library_match(&e, filter))
+        {
+            fprintf(out, "%s\n", e.path);
+            count++;
+        }
+    }
+
+    fclose(f);
+    return count;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef MEM_H
+#define MEM_H
+
+// static memory footprint per subsystem, printed at startup to check a build against MEM_BUDGET
+// frontends add their own buffers with mem_line() between mem_report() and mem_end()
+
+#include <stdio.h>
+
+#include "nes.h"
+
+uint32 mem_total;
+
+void mem_line(FILE *f, const char *name, uint32 size)
+{
+    fprintf(f, "mem %-10s %8u\n", name, size);
+    mem_total += size;
+}
+
+// call after nes_load, LOWMEM cart storage is only known then
+void mem_report(FILE *f)
+{
+    mem_total = 0;
+
+    mem_line(f, "prg_rom", prg_rom_size);
+    mem_line(f, "chr_rom", chr_rom_size);
+    mem_line(f, "prg_ram", sizeof(prg_ram_buf));
+    mem_line(f, "cpu", sizeof(ram));
+    mem_line(f, "ppu", sizeof(table_name) + sizeof(table_pal) + sizeof(oam));
+    mem_line(f, "screen", sizeof(SCREEN));
+    mem_line(f, "render", sizeof(render_list));
+    mem_line(f, "inflate", sizeof(archive_inflate));
+#ifdef FUSE
+    mem_line(f, "fuse", sizeof(fuse_map));
+#endif
+#ifdef TRACE
+    mem_line(f, "trace", sizeof(trace_ring));
+#endif
+#ifdef PROFILE
+    mem_line(f, "profile", sizeof(prof_pc_rom) + sizeof(prof_pc_ram) + sizeof(prof_sub_calls) + sizeof(prof_sub_incl) + sizeof(prof_sub_self));
+#endif
+#ifdef PERF
+    mem_line(f, "perf", sizeof(perf_rec));
+#endif
+}
+
+void mem_end(FILE *f)
+{
+    fprintf(f, "mem %-10s %8u", "total", mem_total);
+#ifdef MEM_BUDGET
+    fprintf(f, " of %u%s", MEM_BUDGET, (mem_total > MEM_BUDGET) ? " OVER BUDGET" : "");
+#endif
+    fprintf(f, "\n");
+}
+
+#endif
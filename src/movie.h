@@ -0,0 +1,172 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <stdio.h>
+
+#include "common.h"
+#include "render.h"
+
+// movie file: "NESM", u16 version, u16 reserved, then run-length records
+// of { u8 joy0, u8 joy1, u16 frames } in little endian
+
+#define MOVIE_OFF           0
+#define MOVIE_RECORD        1
+#define MOVIE_REPLAY        2
+
+#define MOVIE_VERSION       1
+
+uint32 movie_mode;
+FILE *movie_file;
+uint32 movie_frame;             // frames recorded or replayed so far
+uint8 movie_joy[2];             // current run
+uint32 movie_run;               // frames left (replay) or accumulated (record) in the current run
+
+static void movie_put16(uint32 v)
+{
+    fputc(v & 0xFF, movie_file);
+    fputc((v >> 8) & 0xFF, movie_file);
+}
+
+static sint32 movie_get16(uint32 *v)
+{
+    sint32 l = fgetc(movie_file);
+    sint32 h = fgetc(movie_file);
+    if (l == EOF || h == EOF)
+        return 0;
+    *v = l | (h << 8);
+    return 1;
+}
+
+static void movie_flush_run(void)
+{
+    if (movie_run)
+    {
+        fputc(movie_joy[0], movie_file);
+        fputc(movie_joy[1], movie_file);
+        movie_put16(movie_run);
+        movie_run = 0;
+    }
+}
+
+void movie_close(void)
+{
+    if (movie_mode == MOVIE_RECORD)
+    {
+        movie_flush_run();
+    }
+    if (movie_file)
+    {
+        fclose(movie_file);
+        movie_file = NULL;
+    }
+    movie_mode = MOVIE_OFF;
+}
+
+sint32 movie_record(const char *path)
+{
+    movie_close();
+    if (!(movie_file = fopen(path, "wb")))
+        return 0;
+    fwrite("NESM", 1, 4, movie_file);
+    movie_put16(MOVIE_VERSION);
+    movie_put16(0);
+    movie_mode = MOVIE_RECORD;
+    movie_frame = 0;
+    movie_run = 0;
+    return 1;
+}
+
+sint32 movie_replay(const char *path)
+{
+    char magic[4];
+    uint32 version, reserved;
+
+    movie_close();
+    if (!(movie_file = fopen(path, "rb")))
+        return 0;
+
+    if (fread(magic, 1, 4, movie_file) != 4 || memcmp(magic, "NESM", 4) ||
+        !movie_get16(&version) || version != MOVIE_VERSION || !movie_get16(&reserved))
+    {
+        LOG("bad movie %s", path);
+        fclose(movie_file);
+        movie_file = NULL;
+        return 0;
+    }
+
+    movie_mode = MOVIE_REPLAY;
+    movie_frame = 0;
+    movie_run = 0;
+    return 1;
+}
+
+// called once per frame boundary, latches the input the game sees through $4016/$4017 next frame
+void movie_input(const uint8 *live)
+{
+    if (movie_mode == MOVIE_REPLAY)
+    {
+        if (!movie_run)
+        {
+            sint32 j0 = fgetc(movie_file);
+            sint32 j1 = fgetc(movie_file);
+            if (j0 == EOF || j1 == EOF || !movie_get16(&movie_run) || !movie_run)
+            {
+                movie_close();
+                joy_state[0] = joy_state[1] = 0;
+                return;
+            }
+            movie_joy[0] = j0;
+            movie_joy[1] = j1;
+        }
+        movie_run--;
+        joy_state[0] = movie_joy[0];
+        joy_state[1] = movie_joy[1];
+        movie_frame++;
+        return;
+    }
+
+    joy_state[0] = live[0];
+    joy_state[1] = live[1];
+
+    if (movie_mode == MOVIE_RECORD)
+    {
+        if (movie_run && (movie_run == 0xFFFF || movie_joy[0] != live[0] || movie_joy[1] != live[1]))
+        {
+            movie_flush_run();
+        }
+        movie_joy[0] = live[0];
+        movie_joy[1] = live[1];
+        movie_run++;
+        movie_frame++;
+    }
+}
+
+// fast 64-bit hash, byte order independent
+uint64 hash64(const void *data, uint32 size, uint64 h)
+{
+    const uint8 *p = (const uint8*)data;
+    uint32 i;
+
+    for (i = 0; i + 8 <= size; i += 8, p += 8)
+    {
+        uint64 v = (uint64)(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32)p[3] << 24)) |
+                   ((uint64)(p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32)p[7] << 24)) << 32);
+        h = (h ^ v) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
+    }
+
+    for (; i < size; i++, p++)
+    {
+        h = (h ^ *p) * 0x100000001B3ULL;
+    }
+
+    return h ^ (h >> 32);
+}
+
+uint64 movie_hash(void)
+{
+    uint64 h = hash64(ram, sizeof(ram), 0xCBF29CE484222325ULL);
+    return hash64(SCREEN, sizeof(SCREEN), h);
+}
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef NES_H
+#define NES_H
+
+#include <stdio.h>
+
+#include "common.h"
+#include "cart.h"
+#include "archive.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "apu.h"
+#include "render.h"
+#include "ppu_dot.h"
+#include "movie.h"
+#include "sram.h"
+#include "profile.h"
+#include "perf.h"
+#include "trace.h"
+#include "fuse.h"
+#include "library.h"
+
+// raw, gzip or zip, PRG and CHR are decoded straight into the cart storage
+sint32 nes_load(const char *path)
+{
+    CART_STREAM s;
+
+    cart_stream_begin(&s, 1);
+    if (!archive_load(path, cart_stream_sink, &s))
+    {
+        cart_stream_free(&s);
+        return 0;
+    }
+    if (!cart_stream_end(&s))
+        return 0;
+
+    sram_close();
+    memset(prg_ram_buf, 0, sizeof(prg_ram_buf));
+    if (sram_enabled && (cart_header.flags6 & CART_BATTERY))
+    {
+        sram_open(path);
+    }
+    return 1;
+}
+
+void nes_close(void)
+{
+    sram_close();
+}
+
+void nes_reset(void)
+{
+    cart_reset();
+#ifdef FUSE
+    fuse_build();
+#endif
+
+    cpu_reset();
+    ppu_reset();
+    ppu_dot_reset();
+    apu_reset();
+}
+
+// tile renderer, CPU and PPU advance a whole scanline at a time
+uint32 nes_scanline_fast(void)
+{
+    PERF_TIME(PERF_CPU, cpu_clock(CPU_LINE_CYCLES));
+    PERF_TIME(PERF_PPU, ppu_scan());
+
+    if ((scanline <= 240) && ((scanline & 7) == 0))
+    {
+        if (scanline == 0 && (render_mode & RENDER_MODE_LIST))
+        {
+            render_list_begin();
+        }
+
+        if (PPU_MASK & PPU_MASK_BG_EN)
+        {
+            if (render_mode & RENDER_MODE_DIRECT)
+            {
+                PERF_TIME(PERF_BG, draw_bg_row(scanline >> 3));
+            }
+            if (render_mode & RENDER_MODE_LIST)
+            {
+                render_list_row(scanline >> 3);
+            }
+        }
+    }
+
+    if (scanline == 241)
+    {
+        if (PPU_MASK & PPU_MASK_SP_EN)
+        {
+            if (render_mode & RENDER_MODE_DIRECT)
+            {
+                PERF_TIME(PERF_SPR, draw_spr());
+            }
+            if (render_mode & RENDER_MODE_LIST)
+            {
+                render_list_spr();
+            }
+        }
+
+        if ((render_mode & RENDER_MODE_LIST) && render_backend)
+        {
+            render_backend->draw(&render_list);
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
+// accuracy tiers behind a common scanline interface
+typedef struct
+{
+    const char *name;
+    uint32 (*scanline)(void);
+} PPU_TIER;
+
+const PPU_TIER ppu_tier_fast = { "fast", nes_scanline_fast };
+const PPU_TIER ppu_tier_dot = { "dot", nes_scanline_dot };    // draws into SCREEN only, no display list
+const PPU_TIER *ppu_tier = &ppu_tier_fast;
+
+// runs one scanline, returns 1 when the frame is ready to present
+uint32 nes_scanline(void)
+{
+    if (ppu_tier->scanline())
+    {
+        sram_flush();
+        return 1;
+    }
+    return 0;
+}
+
+const PPU_TIER* nes_tier_find(const char *name)
+{
+    if (!strcmp(name, ppu_tier_fast.name))
+        return &ppu_tier_fast;
+    if (!strcmp(name, ppu_tier_dot.name))
+        return &ppu_tier_dot;
+    return NULL;
+}
+
+// picks the tier for the loaded cart
+// mappers with CHR latches or scanline counters (MMC2, MMC3, MMC4, MMC5) default to the dot tier,
+// the optional database overrides it with "mapper <n> <tier>" and "crc <crc32> <tier>" lines,
+// CRC lines win over mapper lines
+const PPU_TIER* nes_tier_select(const char *db)
+{
+    const PPU_TIER *tier = &ppu_tier_fast;
+    const PPU_TIER *by_crc = NULL;
+    char line[256], key[16], name[16];
+    uint32 value;
+    FILE *f;
+
+    if (mapper == 4 || mapper == 5 || mapper == 9 || mapper == 10)
+    {
+        tier = &ppu_tier_dot;
+    }
+
+    if (db && (f = fopen(db, "r")))
+    {
+        while (fgets(line, sizeof(line), f))
+        {
+            const PPU_TIER *t;
+
+            if (line[0] == '#' || sscanf(line, "%15s %x %15s", key, &value, name) != 3 || !(t = nes_tier_find(name)))
+                continue;
+
+            if (!strcmp(key, "crc") && value == cart_crc)
+                by_crc = t;
+            else if (!strcmp(key, "mapper") && sscanf(line, "%*s %u", &value) == 1 && value == mapper)
+                tier = t;
+        }
+        fclose(f);
+    }
+
+    return by_crc ? by_crc : tier;
+}
+
+#endif
@@ -0,0 +1,186 @@
+#ifndef PERF_H
+#define PERF_H
+
+// per-frame stage timers, build with PERF defined, otherwise PERF_TIME() is just the statement
+
+#include "common.h"
+
+#define PERF_CPU            0
+#define PERF_PPU            1
+#define PERF_BG             2
+#define PERF_SPR            3
+#define PERF_BLIT           4
+#define PERF_STAGES         5
+
+#ifdef PERF
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "timer.h"
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    #include <intrin.h>
+    #define PERF_TICKS()    __rdtsc()
+#elif defined(__i386__) || defined(__x86_64__)
+    #include <x86intrin.h>
+    #define PERF_TICKS()    __rdtsc()
+#else
+    #define PERF_TICKS()    time_ns()
+#endif
+
+#define PERF_FRAMES         3600 // one minute at 60 fps
+
+#define PERF_TIME(stage, stmt) { uint64 perf_t = PERF_TICKS(); stmt; perf_acc[stage] += PERF_TICKS() - perf_t; }
+#define PERF_FRAME()        perf_frame()
+
+const char *perf_name[PERF_STAGES] = { "cpu", "ppu", "bg", "spr", "blit" };
+
+typedef struct
+{
+    uint32 stage[PERF_STAGES];  // ticks
+    uint32 total;               // ticks since the previous frame
+} PERF_RECORD;
+
+uint64 perf_acc[PERF_STAGES];
+PERF_RECORD perf_rec[PERF_FRAMES];
+uint32 perf_count;              // frames recorded, ring index is perf_count % PERF_FRAMES
+uint64 perf_last;
+uint64 perf_tick0, perf_ns0;
+uint32 perf_overlay;
+
+void perf_frame(void)
+{
+    uint64 now = PERF_TICKS();
+    PERF_RECORD *r = perf_rec + (perf_count % PERF_FRAMES);
+    uint32 i;
+
+    if (!perf_last)
+    {
+        perf_tick0 = now;
+        perf_ns0 = time_ns();
+    }
+    else
+    {
+        for (i = 0; i < PERF_STAGES; i++)
+        {
+            r->stage[i] = (uint32)perf_acc[i];
+        }
+        r->total = (uint32)(now - perf_last);
+        perf_count++;
+    }
+
+    memset(perf_acc, 0, sizeof(perf_acc));
+    perf_last = now;
+}
+
+double perf_ns_per_tick(void)
+{
+    uint64 ticks = PERF_TICKS() - perf_tick0;
+    uint64 ns = time_ns() - perf_ns0;
+    return ticks ? (double)ns / (double)ticks : 1.0;
+}
+
+// horizontal bar per stage along the top of the frame, full width is a 60 fps frame
+void perf_draw(uint8 *screen)
+{
+    static const uint8 colors[PERF_STAGES] = { 0x16, 0x2A, 0x12, 0x28, 0x24 };
+    const PERF_RECORD *r;
+    double scale;
+    uint32 i, x = 0, y;
+
+    if (!perf_overlay || !perf_count)
+        return;
+
+    r = perf_rec + ((perf_count - 1) % PERF_FRAMES);
+    scale = perf_ns_per_tick() * FRAME_WIDTH / 16666667.0;
+
+    for (i = 0; i < PERF_STAGES; i++)
+    {
+        uint32 w = (uint32)(r->stage[i] * scale + 0.5);
+        for (; w && x < FRAME_WIDTH; w--, x++)
+        {
+            for (y = 0; y < 4; y++)
+            {
+                screen[y * FRAME_WIDTH + x] = colors[i];
+            }
+        }
+    }
+
+    for (y = 0; y < 4; y++)
+    {
+        screen[y * FRAME_WIDTH + FRAME_WIDTH - 1] = 0x30;
+    }
+}
+
+static int perf_cmp(const void *a, const void *b)
+{
+    uint32 x = *(const uint32*)a;
+    uint32 y = *(const uint32*)b;
+    return (x > y) - (x < y);
+}
+
+// min/avg/p99 in microseconds over the recorded frames
+void perf_summary(FILE *f)
+{
+    static uint32 v[PERF_FRAMES];
+    uint32 n = (perf_count < PERF_FRAMES) ? perf_count : PERF_FRAMES;
+    double k = perf_ns_per_tick() / 1000.0;
+    uint32 s, i;
+
+    if (!n)
+        return;
+
+    fprintf(f, "stage    min_us    avg_us    p99_us\n");
+    for (s = 0; s <= PERF_STAGES; s++)
+    {
+        double sum = 0.0;
+        for (i = 0; i < n; i++)
+        {
+            v[i] = (s == PERF_STAGES) ? perf_rec[i].total : perf_rec[i].stage[s];
+            sum += v[i];
+        }
+        qsort(v, n, sizeof(v[0]), perf_cmp);
+        fprintf(f, "%-6s %8.1f  %8.1f  %8.1f\n", (s == PERF_STAGES) ? "frame" : perf_name[s], v[0] * k, sum / n * k, v[(n * 99) / 100] * k);
+    }
+}
+
+// per-frame records in microseconds, oldest first
+sint32 perf_dump(const char *path)
+{
+    uint32 n = (perf_count < PERF_FRAMES) ? perf_count : PERF_FRAMES;
+    double k = perf_ns_per_tick() / 1000.0;
+    uint32 i, s;
+    FILE *f = fopen(path, "w");
+
+    if (!f)
+        return 0;
+
+    fprintf(f, "frame");
+    for (s = 0; s < PERF_STAGES; s++)
+    {
+        fprintf(f, ",%s_us", perf_name[s]);
+    }
+    fprintf(f, ",frame_us\n");
+
+    for (i = perf_count - n; i < perf_count; i++)
+    {
+        const PERF_RECORD *r = perf_rec + (i % PERF_FRAMES);
+        fprintf(f, "%u", i);
+        for (s = 0; s < PERF_STAGES; s++)
+        {
+            fprintf(f, ",%.2f", r->stage[s] * k);
+        }
+        fprintf(f, ",%.2f\n", r->total * k);
+    }
+
+    fclose(f);
+    return 1;
+}
+
+#else
+    #define PERF_TIME(stage, stmt) stmt
+    #define PERF_FRAME()
+#endif
+
+#endif
@@ -17,7 +17,11 @@
 #define PPU_MASK_SP_TRIM    (1 << 2)
 #define PPU_MASK_BG_EN      (1 << 3)
 #define PPU_MASK_SP_EN      (1 << 4)
+#define PPU_MASK_EMP_R      (1 << 5)
+#define PPU_MASK_EMP_G      (1 << 6)
+#define PPU_MASK_EMP_B      (1 << 7)
 #define PPU_MASK_EN         (PPU_MASK_BG_EN | PPU_MASK_SP_EN)
+#define PPU_MASK_COLOR      (PPU_MASK_GRAY | PPU_MASK_EMP_R | PPU_MASK_EMP_G | PPU_MASK_EMP_B)
 
 #define PPU_STATUS_SP_OV    (1 << 5)
 #define PPU_STATUS_SP_HIT   (1 << 6)
@@ -31,9 +35,6 @@
 #define PPU_SCROLL_X(reg)   (reg & 0x00FF)
 #define PPU_SCROLL_Y(reg)   ((reg & 0xFF00) >> 8)
 
-#define TBL_MIRROR_H        0
-#define TBL_MIRROR_V        1
-
 uint32 PPU_CTRL;
 uint32 PPU_MASK;
 uint32 PPU_STATUS;
@@ -48,73 +49,67 @@ sint32 scanline;
 uint32 latch;
 uint32 latch_data;
 
+// loopy registers for the dot renderer, PPU_ADDR doubles as v
+uint32 ppu_t;
+uint32 ppu_x;
+
 void ppu_reset(void)
 {
     scanline = -1;
     latch = 0;
+    ppu_t = 0;
+    ppu_x = 0;
 }
 
-uint8* get_vram_ptr(uint32 addr)
+static const uint8 mirror_pages[5][4] = {
+    { 0, 0, 1, 1 }, // TBL_MIRROR_H
+    { 0, 1, 0, 1 }, // TBL_MIRROR_V
+    { 0, 0, 0, 0 }, // TBL_MIRROR_S0
+    { 1, 1, 1, 1 }, // TBL_MIRROR_S1
+    { 0, 1, 2, 3 }  // TBL_MIRROR_4
+};
+
+// sprite backdrop entries $3F10/$3F14/$3F18/$3F1C mirror $3F00/$3F04/$3F08/$3F0C
+static const uint8 pal_mirror[32] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+    0x00, 0x11, 0x12, 0x13, 0x04, 0x15, 0x16, 0x17, 0x08, 0x19, 0x1A, 0x1B, 0x0C, 0x1D, 0x1E, 0x1F
+};
+
+// called by the cart on load and by mappers that switch mirroring at runtime
+void ppu_mirror(uint32 mode)
 {
-    if (addr >= 0x0000 && addr <= 0x1FFF)
+    uint32 i;
+    ASSERT(mode <= TBL_MIRROR_4);
+    table_mirror = mode;
+    for (i = 0; i < 4; i++)
     {
-        return chr_rom + addr;
+        table_page[i] = table_name[mirror_pages[mode][i]];
     }
-    else if (addr >= 0x2000 && addr <= 0x3EFF)
-    {
-        uint32 tile = addr & 0x03FF;
-        addr &= 0x0FFF;
+}
 
-        if (table_mirror == TBL_MIRROR_V)
-        {
-            if (addr >= 0x0000 && addr <= 0x03FF)
-                return table_name[0] + tile;
-            if (addr >= 0x0400 && addr <= 0x07FF)
-                return table_name[1] + tile;
-            if (addr >= 0x0800 && addr <= 0x0BFF)
-                return table_name[0] + tile;
-            if (addr >= 0x0C00 && addr <= 0x0FFF)
-                return table_name[1] + tile;
-        }
-        else
-        {
-            if (addr >= 0x0000 && addr <= 0x03FF)
-                return table_name[0] + tile;
-            if (addr >= 0x0400 && addr <= 0x07FF)
-                return table_name[0] + tile;
-            if (addr >= 0x0800 && addr <= 0x0BFF)
-                return table_name[1] + tile;
-            if (addr >= 0x0C00 && addr <= 0x0FFF)
-                return table_name[1] + tile;
-        }
+uint8* get_vram_ptr(uint32 addr)
+{
+    addr &= 0x3FFF;
+
+    if (addr < 0x2000)
+    {
+        return chr_rom + addr;
     }
-    else if (addr >= 0x3F00 && addr <= 0x3FFF)
+    else if (addr < 0x3F00)
     {
-        addr &= 0x1F;
-        if (addr == 0x10 || addr == 0x14 || addr == 0x18 || addr == 0x1C)
-        {
-            addr = 0x00;
-        }
-        return table_pal + addr;
+        return table_page[(addr >> 10) & 3] + (addr & 0x03FF);
     }
-
-    ASSERT(0);
-    return NULL;
+    return table_pal + pal_mirror[addr & 0x1F];
 }
 
 uint32 vram_read(uint32 addr)
 {
-    uint8 *ptr = get_vram_ptr(addr);
-    return ptr ? *ptr : 0;
+    return *get_vram_ptr(addr);
 }
 
 void vram_write(uint32 addr, uint32 data)
 {
-    uint8 *ptr = get_vram_ptr(addr);
-    if (ptr)
-    {
-        *ptr = data;
-    }
+    *get_vram_ptr(addr) = data;
 }
 
 uint32 ppu_read(uint32 addr)
@@ -159,6 +154,7 @@ void ppu_write(uint32 addr, uint32 data)
     {
         case 0:
             PPU_CTRL = data;
+            ppu_t = (ppu_t & ~0x0C00) | ((data & 3) << 10);
             break;
         case 1:
             PPU_MASK = data;
@@ -175,10 +171,13 @@ void ppu_write(uint32 addr, uint32 data)
             if (latch == 0)
             {
                 latch_data = data;
+                ppu_t = (ppu_t & ~0x001F) | (data >> 3);
+                ppu_x = data & 7;
             }
             else
             {
                 PPU_SCROLL = latch_data | (data << 8);
+                ppu_t = (ppu_t & ~0x73E0) | ((data & 7) << 12) | ((data & 0xF8) << 2);
             }
             latch ^= 1;
             break;
@@ -186,10 +185,12 @@ void ppu_write(uint32 addr, uint32 data)
             if (latch == 0)
             {
                 latch_data = (data << 8);
+                ppu_t = (ppu_t & 0x00FF) | ((data & 0x3F) << 8);
             }
             else
             {
-                PPU_ADDR = latch_data | data;
+                ppu_t = (ppu_t & 0xFF00) | data;
+                PPU_ADDR = ppu_t;
             }
             latch ^= 1;
             break;
@@ -0,0 +1,344 @@
+#ifndef PPU_DOT_H
+#define PPU_DOT_H
+
+// dot-accurate PPU: background fetch pipeline with shift registers, loopy v/t/x scrolling,
+// per-line sprite evaluation (with the hardware overflow bug) and per-dot sprite 0 hit
+// slower than the tile renderer, selected per ROM through the tier database in nes.h
+
+#include "common.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "render.h"
+
+uint32 dot;                         // 0..340
+uint32 dot_odd;                     // odd frames skip the last pre-render dot
+
+uint32 dot_bg_lo;                   // pattern shifters, high byte is the current tile
+uint32 dot_bg_hi;
+uint32 dot_at_lo;                   // attribute shifters, expanded to 8 bits per tile
+uint32 dot_at_hi;
+uint32 dot_nt;                      // fetch latches
+uint32 dot_at;
+uint32 dot_pt_lo;
+uint32 dot_pt_hi;
+
+uint32 dot_spr_count;               // sprites on the current line
+uint32 dot_spr_zero;                // sprite 0 is among them (always the first one)
+uint8 dot_spr_x[8];
+uint8 dot_spr_lo[8];                // pattern bits, already flipped horizontally
+uint8 dot_spr_hi[8];
+uint8 dot_spr_attr[8];
+
+// mappers with CHR latches (MMC2) or A12 counters (MMC3) watch pattern fetches here
+void (*ppu_chr_hook)(uint32 addr);
+
+void ppu_dot_reset(void)
+{
+    dot = 0;
+    dot_odd = 0;
+    dot_spr_count = 0;
+    dot_spr_zero = 0;
+}
+
+static uint32 dot_read(uint32 addr)
+{
+    if (ppu_chr_hook && addr < 0x2000)
+    {
+        ppu_chr_hook(addr);
+    }
+    return *get_vram_ptr(addr);
+}
+
+static void dot_inc_x(void)
+{
+    if ((PPU_ADDR & 0x001F) == 31)
+    {
+        PPU_ADDR &= ~0x001F;
+        PPU_ADDR ^= 0x0400;
+    }
+    else
+    {
+        PPU_ADDR++;
+    }
+}
+
+static void dot_inc_y(void)
+{
+    if ((PPU_ADDR & 0x7000) != 0x7000)
+    {
+        PPU_ADDR += 0x1000;
+    }
+    else
+    {
+        uint32 y = (PPU_ADDR & 0x03E0) >> 5;
+
+        PPU_ADDR &= ~0x7000;
+        if (y == 29)
+        {
+            y = 0;
+            PPU_ADDR ^= 0x0800;
+        }
+        else if (y == 31)
+        {
+            y = 0;
+        }
+        else
+        {
+            y++;
+        }
+        PPU_ADDR = (PPU_ADDR & ~0x03E0) | (y << 5);
+    }
+}
+
+static void dot_load(void)
+{
+    dot_bg_lo = (dot_bg_lo & 0xFF00) | dot_pt_lo;
+    dot_bg_hi = (dot_bg_hi & 0xFF00) | dot_pt_hi;
+    dot_at_lo = (dot_at_lo & 0xFF00) | ((dot_at & 1) ? 0xFF : 0x00);
+    dot_at_hi = (dot_at_hi & 0xFF00) | ((dot_at & 2) ? 0xFF : 0x00);
+}
+
+static void dot_fetch(void)
+{
+    uint32 table = (PPU_CTRL & PPU_CTRL_PAT_BG) ? 0x1000 : 0x0000;
+    uint32 fine_y = (PPU_ADDR >> 12) & 7;
+
+    switch ((dot - 1) & 7)
+    {
+        case 0 :
+            dot_load();
+            dot_nt = dot_read(0x2000 | (PPU_ADDR & 0x0FFF));
+            break;
+        case 2 :
+            dot_at = dot_read(0x23C0 | (PPU_ADDR & 0x0C00) | ((PPU_ADDR >> 4) & 0x38) | ((PPU_ADDR >> 2) & 0x07));
+            if (PPU_ADDR & 0x0040)
+                dot_at >>= 4;
+            if (PPU_ADDR & 0x0002)
+                dot_at >>= 2;
+            dot_at &= 3;
+            break;
+        case 4 :
+            dot_pt_lo = dot_read(table + dot_nt * 16 + fine_y);
+            break;
+        case 6 :
+            dot_pt_hi = dot_read(table + dot_nt * 16 + fine_y + 8);
+            break;
+        case 7 :
+            dot_inc_x();
+            break;
+    }
+}
+
+static uint32 dot_flip(uint32 b)
+{
+    b = ((b & 0xF0) >> 4) | ((b & 0x0F) << 4);
+    b = ((b & 0xCC) >> 2) | ((b & 0x33) << 2);
+    b = ((b & 0xAA) >> 1) | ((b & 0x55) << 1);
+    return b;
+}
+
+// picks the sprites of the next line, done at once at dot 257 instead of over dots 65-320
+static void dot_sprites(sint32 line)
+{
+    const uint8 *mem = (const uint8*)oam;
+    uint32 h = (PPU_CTRL & PPU_CTRL_SIZE) ? 16 : 8;
+    uint32 n, m, i;
+
+    dot_spr_count = 0;
+    dot_spr_zero = 0;
+
+    for (n = 0; n < 64 && dot_spr_count < 8; n++)
+    {
+        uint32 row = (uint32)(line - mem[n * 4]);
+        if (row < h)
+        {
+            uint32 tile = mem[n * 4 + 1];
+            uint32 attr = mem[n * 4 + 2];
+            uint32 addr;
+
+            if (attr & PPU_SPR_FLIP_V)
+                row = h - 1 - row;
+
+            if (h == 16)
+                addr = ((tile & 1) << 12) + ((tile & ~1) + (row >> 3)) * 16 + (row & 7);
+            else
+                addr = ((PPU_CTRL & PPU_CTRL_PAT_SP) ? 0x1000 : 0x0000) + tile * 16 + row;
+
+            i = dot_spr_count++;
+            dot_spr_x[i] = mem[n * 4 + 3];
+            dot_spr_attr[i] = attr;
+            dot_spr_lo[i] = dot_read(addr);
+            dot_spr_hi[i] = dot_read(addr + 8);
+
+            if (attr & PPU_SPR_FLIP_H)
+            {
+                dot_spr_lo[i] = dot_flip(dot_spr_lo[i]);
+                dot_spr_hi[i] = dot_flip(dot_spr_hi[i]);
+            }
+
+            if (n == 0)
+                dot_spr_zero = 1;
+        }
+    }
+
+    // overflow search keeps stepping the byte index on misses, like the hardware does
+    for (m = 0; n < 64; )
+    {
+        if ((uint32)(line - mem[n * 4 + m]) < h)
+        {
+            PPU_STATUS |= PPU_STATUS_SP_OV;
+            break;
+        }
+        n++;
+        m = (m + 1) & 3;
+    }
+}
+
+static void dot_pixel(sint32 line)
+{
+    uint32 x = dot - 1;
+    uint32 bg = 0, bg_pal = 0, sp = 0, sp_pal = 0, sp_prio = 0, i;
+    uint32 color;
+
+    if ((PPU_MASK & PPU_MASK_BG_EN) && ((PPU_MASK & PPU_MASK_BG_TRIM) || x >= 8))
+    {
+        uint32 bit = 0x8000 >> ppu_x;
+        bg = ((dot_bg_lo & bit) ? 1 : 0) | ((dot_bg_hi & bit) ? 2 : 0);
+        bg_pal = ((dot_at_lo & bit) ? 1 : 0) | ((dot_at_hi & bit) ? 2 : 0);
+    }
+
+    if ((PPU_MASK & PPU_MASK_SP_EN) && ((PPU_MASK & PPU_MASK_SP_TRIM) || x >= 8))
+    {
+        for (i = 0; i < dot_spr_count; i++)
+        {
+            uint32 sx = x - dot_spr_x[i];
+            if (sx < 8)
+            {
+                uint32 p = ((dot_spr_lo[i] >> (7 - sx)) & 1) | (((dot_spr_hi[i] >> (7 - sx)) & 1) << 1);
+                if (!p)
+                    continue;
+
+                if (i == 0 && dot_spr_zero && bg && x != 255)
+                {
+                    PPU_STATUS |= PPU_STATUS_SP_HIT;
+                }
+
+                sp = p;
+                sp_pal = dot_spr_attr[i] & PPU_SPR_PAL;
+                sp_prio = dot_spr_attr[i] & PPU_SPR_PRIO;
+                break;
+            }
+        }
+    }
+
+    if (sp && (!bg || !sp_prio))
+        color = 0x10 | (sp_pal << 2) | sp;
+    else if (bg)
+        color = (bg_pal << 2) | bg;
+    else
+        color = 0;
+
+    SCREEN[line * FRAME_WIDTH + x] = table_pal[pal_mirror[color]] & 0x3F;
+}
+
+// advances one dot, returns 1 when vblank starts
+uint32 ppu_dot_step(void)
+{
+    uint32 frame = 0;
+    uint32 rendering = PPU_MASK & PPU_MASK_EN;
+
+    if (scanline < 240)
+    {
+        if (scanline == -1 && dot == 1)
+        {
+            PPU_STATUS &= ~(PPU_STATUS_VBLANK | PPU_STATUS_SP_OV | PPU_STATUS_SP_HIT);
+        }
+
+        if (rendering)
+        {
+            if ((dot >= 2 && dot <= 257) || (dot >= 322 && dot <= 337))
+            {
+                dot_bg_lo <<= 1;
+                dot_bg_hi <<= 1;
+                dot_at_lo <<= 1;
+                dot_at_hi <<= 1;
+            }
+
+            if (scanline >= 0 && dot >= 1 && dot <= 256)
+            {
+                dot_pixel(scanline);
+            }
+
+            if ((dot >= 1 && dot <= 256) || (dot >= 321 && dot <= 336))
+            {
+                dot_fetch();
+            }
+
+            if (dot == 256)
+            {
+                dot_inc_y();
+            }
+            else if (dot == 257)
+            {
+                dot_load();
+                PPU_ADDR = (PPU_ADDR & ~0x041F) | (ppu_t & 0x041F);
+                if (scanline >= 0)
+                    dot_sprites(scanline);
+                else
+                    dot_spr_count = dot_spr_zero = 0;
+            }
+            else if (scanline == -1 && dot >= 280 && dot <= 304)
+            {
+                PPU_ADDR = (PPU_ADDR & ~0x7BE0) | (ppu_t & 0x7BE0);
+            }
+            else if (scanline == -1 && dot == 339 && dot_odd)
+            {
+                dot++; // odd frames are one dot shorter
+            }
+        }
+        else if (scanline >= 0 && dot >= 1 && dot <= 256)
+        {
+            SCREEN[scanline * FRAME_WIDTH + dot - 1] = table_pal[0] & 0x3F;
+        }
+    }
+    else if (scanline == 241 && dot == 1)
+    {
+        PPU_STATUS |= PPU_STATUS_VBLANK;
+        if (PPU_CTRL & PPU_CTRL_NMI)
+        {
+            cpu_nmi();
+        }
+        frame = 1;
+    }
+
+    if (++dot > 340)
+    {
+        dot = 0;
+        if (++scanline > 260)
+        {
+            scanline = -1;
+            dot_odd ^= 1;
+        }
+    }
+
+    return frame;
+}
+
+// one scanline with the CPU interleaved cycle by cycle (instructions still run whole on their first cycle)
+uint32 nes_scanline_dot(void)
+{
+    sint32 line = scanline;
+    uint32 frame = 0;
+
+    do
+    {
+        cpu_clock(1);
+        frame |= ppu_dot_step();
+        frame |= ppu_dot_step();
+        frame |= ppu_dot_step();
+    } while (scanline == line);
+
+    return frame;
+}
+
+#endif
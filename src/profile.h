@@ -0,0 +1,161 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+// build with PROFILE defined, without it every hook in cpu.h compiles to nothing
+
+#ifdef PROFILE
+
+#include <stdio.h>
+
+#include "common.h"
+#include "cpu.h"
+
+#define PROF_SAMPLE         64  // instructions per PC sample
+#define PROF_STACK          64
+
+typedef struct
+{
+    uint16 addr;
+    uint16 sp;                  // S right after the call pushed its return address
+    uint64 start;
+    uint64 child;
+} PROF_FRAME;
+
+uint64 prof_count[256];
+uint64 prof_cycles[256];
+
+uint32 prof_sample = PROF_SAMPLE;
+uint32 prof_pc_rom[PRG_WINDOW];
+uint32 prof_pc_ram[sizeof(ram)];
+uint32 prof_pc_misc;
+
+uint32 prof_sub_calls[0x10000];
+uint64 prof_sub_incl[0x10000];
+uint64 prof_sub_self[0x10000];
+
+PROF_FRAME prof_stack[PROF_STACK];
+uint32 prof_depth;
+uint32 prof_last_op;
+
+void prof_op(uint32 op)
+{
+    prof_last_op = op;
+    prof_count[op]++;
+    prof_cycles[op] += op_cycles[op];
+
+    if (--prof_sample == 0)
+    {
+        uint32 pc = (PC - 1) & 0xFFFF;
+        prof_sample = PROF_SAMPLE;
+        if (pc >= 0x8000)
+            prof_pc_rom[map_addr(pc)]++;
+        else if (pc < 0x2000)
+            prof_pc_ram[pc & 0x07FF]++;
+        else
+            prof_pc_misc++;
+    }
+}
+
+// DMA and other stalls are charged to the instruction that caused them
+void prof_stall(uint32 cycles)
+{
+    prof_cycles[prof_last_op] += cycles;
+}
+
+void prof_call(uint32 addr)
+{
+    PROF_FRAME *f;
+    if (prof_depth == PROF_STACK)
+        return;
+    f = prof_stack + prof_depth++;
+    f->addr = addr;
+    f->sp = S;
+    f->start = cpu_cycles;
+    f->child = 0;
+}
+
+void prof_ret(void)
+{
+    // S above the frame means it returned, this also unwinds frames whose return address was dropped
+    while (prof_depth && prof_stack[prof_depth - 1].sp < S)
+    {
+        PROF_FRAME *f = prof_stack + --prof_depth;
+        uint64 incl = cpu_cycles - f->start;
+        prof_sub_calls[f->addr]++;
+        prof_sub_incl[f->addr] += incl;
+        prof_sub_self[f->addr] += incl - f->child;
+        if (prof_depth)
+        {
+            prof_stack[prof_depth - 1].child += incl;
+        }
+    }
+}
+
+void prof_reset(void)
+{
+    memset(prof_count, 0, sizeof(prof_count));
+    memset(prof_cycles, 0, sizeof(prof_cycles));
+    memset(prof_pc_rom, 0, sizeof(prof_pc_rom));
+    memset(prof_pc_ram, 0, sizeof(prof_pc_ram));
+    memset(prof_sub_calls, 0, sizeof(prof_sub_calls));
+    memset(prof_sub_incl, 0, sizeof(prof_sub_incl));
+    memset(prof_sub_self, 0, sizeof(prof_sub_self));
+    prof_pc_misc = 0;
+    prof_depth = 0;
+    prof_sample = PROF_SAMPLE;
+}
+
+// writes <prefix>_ops.csv, <prefix>_pc.csv and <prefix>_sub.csv
+sint32 prof_dump(const char *prefix)
+{
+    char path[1024];
+    uint32 i;
+    FILE *f;
+
+    sprintf(path, "%.1000s_ops.csv", prefix);
+    if (!(f = fopen(path, "w")))
+        return 0;
+    fprintf(f, "opcode,name,mode,count,cycles\n");
+    for (i = 0; i < 256; i++)
+    {
+        if (prof_count[i])
+            fprintf(f, "%02X,%s,%s,%llu,%llu\n", i, op_name[i], op_mode[i], prof_count[i], prof_cycles[i]);
+    }
+    fclose(f);
+
+    sprintf(path, "%.1000s_pc.csv", prefix);
+    if (!(f = fopen(path, "w")))
+        return 0;
+    // slot is the 16K half of the $8000-$FFFF window, not the PRG bank mapped there
+    fprintf(f, "region,slot,offset,samples\n");
+    for (i = 0; i < sizeof(prof_pc_rom) / sizeof(prof_pc_rom[0]); i++)
+    {
+        if (prof_pc_rom[i])
+            fprintf(f, "prg,%u,%04X,%u\n", i >> 14, i & 0x3FFF, prof_pc_rom[i]);
+    }
+    for (i = 0; i < sizeof(prof_pc_ram) / sizeof(prof_pc_ram[0]); i++)
+    {
+        if (prof_pc_ram[i])
+            fprintf(f, "ram,0,%04X,%u\n", i, prof_pc_ram[i]);
+    }
+    if (prof_pc_misc)
+        fprintf(f, "misc,0,0000,%u\n", prof_pc_misc);
+    fclose(f);
+
+    sprintf(path, "%.1000s_sub.csv", prefix);
+    if (!(f = fopen(path, "w")))
+        return 0;
+    fprintf(f, "addr,calls,cycles_incl,cycles_self\n");
+    for (i = 0; i < 0x10000; i++)
+    {
+        if (prof_sub_calls[i])
+            fprintf(f, "%04X,%u,%llu,%llu\n", i, prof_sub_calls[i], prof_sub_incl[i], prof_sub_self[i]);
+    }
+    fclose(f);
+
+    return 1;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,288 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "common.h"
+#include "ppu.h"
+
+uint8 SCREEN[FRAME_WIDTH * FRAME_HEIGHT]; // NES colour indices, see video.h
+
+// display list for backends that draw whole tiles (e.g. the 3DO cel engine)
+#define RENDER_ROWS         31
+#define RENDER_ROW_TILES    33
+#define RENDER_SPRITES      128 // 64 OAM entries, two tiles each in 8x16 mode
+
+#define RENDER_MODE_DIRECT  (1 << 0) // per-pixel draw_bg_row / draw_spr into SCREEN
+#define RENDER_MODE_LIST    (1 << 1) // build render_list and hand it to render_backend
+
+#define RENDER_SPR_FLIP_H   (1 << 0)
+#define RENDER_SPR_FLIP_V   (1 << 1)
+#define RENDER_SPR_BEHIND   (1 << 2)
+
+typedef struct
+{
+    sint16 x;               // first tile position, fine scroll applied
+    sint16 y;
+    uint8 chr;              // pattern table
+    uint8 count;
+    uint8 pal[16];          // background palette when the row was fetched
+    uint8 tile[RENDER_ROW_TILES];
+    uint8 attr[RENDER_ROW_TILES]; // palette select 0..3
+} RENDER_ROW;
+
+typedef struct
+{
+    sint16 x;
+    sint16 y;
+    uint8 tile;
+    uint8 chr;
+    uint8 pal;              // palette select 0..3
+    uint8 flags;            // RENDER_SPR_*
+} RENDER_SPRITE;
+
+typedef struct
+{
+    uint32 row_count;
+    uint32 spr_count;
+    uint8 spr_pal[32];
+    RENDER_ROW row[RENDER_ROWS];
+    RENDER_SPRITE spr[RENDER_SPRITES];
+} RENDER_LIST;
+
+typedef struct
+{
+    const char *name;
+    void (*draw)(const RENDER_LIST *list);
+} RENDER_BACKEND;
+
+uint32 render_mode = RENDER_MODE_DIRECT;
+RENDER_LIST render_list;
+const RENDER_BACKEND *render_backend;
+
+void pal_update()
+{
+    table_pal[0x10] =
+    table_pal[0x14] =
+    table_pal[0x18] =
+    table_pal[0x1C] = table_pal[0x00];
+}
+
+void draw_tile(uint8 *dst, const uint8 *colors, sint32 index, uint32 chr, uint32 pal, uint32 flip, uint32 trans, sint32 x, sint32 y)
+{
+    const uint8 *ptr = (chr_rom + index * 16) + chr * (16 * 16 * 16);
+    sint32 ix, iy, i;
+
+    for (iy = 0; iy < 8; iy++)
+    {
+        uint8 a = ptr[iy];
+        uint8 b = ptr[iy + 8];
+
+        for (ix = 0; ix < 8; ix++)
+        {
+            i = (a >> 7) | ((b >> 6) & 2);
+
+            a <<= 1;
+            b <<= 1;
+
+            if (trans && i == 0)
+                continue;
+
+            if (i != 0)
+            {
+                i |= pal;
+            }
+
+            sint32 sx = x + ((flip & 1) ? (7 - ix) : ix);
+            sint32 sy = y + ((flip & 2) ? (7 - iy) : iy);
+
+            if (sx >= 0 && sx <= 255 && sy >= 0 && sy <= 239)
+            {
+                dst[sy * FRAME_WIDTH + sx] = colors[i] & 0x3F;
+            }
+        }
+    }
+}
+
+void draw_sprite(sint32 index, uint32 chr, uint32 pal, uint32 flip, uint32 trans, sint32 x, sint32 y)
+{
+    draw_tile(SCREEN, table_pal, index, chr, pal, flip, trans, x, y);
+}
+
+void draw_bg_row(sint32 row)
+{
+    uint32 table_addr = 0x2000 + (PPU_CTRL & 3) * 0x400;
+    
+    uint32 chr = (PPU_CTRL & PPU_CTRL_PAT_BG) >> 4;
+    sint32 scroll_x = PPU_SCROLL_X(PPU_SCROLL);
+    sint32 scroll_y = PPU_SCROLL_Y(PPU_SCROLL);
+
+    sint32 cx = (scroll_x >> 3);
+    sint32 cy = (scroll_y >> 3);
+    sint32 fx = (scroll_x & 7);
+    sint32 fy = (scroll_y & 7);
+
+    sint32 y, x;
+    sint32 w = 32 + ((PPU_MASK & PPU_MASK_BG_TRIM) ? 1 : 0);
+
+    pal_update();
+
+    y = cy + row;
+    if (y >= 30)
+    {
+        table_addr += 0x800;
+        y -= 30;
+    }
+
+    for (x = 0; x < w; x++, cx++)
+    {
+        if (cx >= 32)
+        {
+            table_addr += 0x400;
+            cx -= 32;
+        }
+
+        uint8 *table = get_vram_ptr(table_addr);
+
+        uint32 spr = table[y * 32 + cx];
+        uint32 pal = table[30 * 32 + ((y >> 2) << 3) + (cx >> 2)];
+
+        uint32 sx = (cx & 2);
+        uint32 sy = (y & 2) << 1;
+
+        pal = (pal >> (sx | sy)) & 3;
+
+        draw_sprite(spr, chr, (pal << 2), 0, 0, x * 8 - fx, row * 8 - fy);
+    }
+}
+
+void draw_spr(void)
+{
+    uint32 i, id;
+    PPU_SPRITE *spr = oam;
+    uint32 chr = (PPU_CTRL & PPU_CTRL_PAT_SP) >> 4;
+
+    pal_update();
+
+    for (i = 0; i < 64; i++, spr++)
+    {
+        if (spr->y >= 0xEF)
+            continue;
+
+        if (PPU_CTRL & PPU_CTRL_SIZE)
+        {
+            chr = (spr->id & 1);
+            id = spr->id & ~1;
+            draw_sprite(id, chr, ((spr->attr & PPU_SPR_PAL) << 2) | (1 << 4), spr->attr >> 6, 1, spr->x, spr->y);
+            draw_sprite(id + 1, chr, ((spr->attr & PPU_SPR_PAL) << 2) | (1 << 4), spr->attr >> 6, 1, spr->x, spr->y + 8);
+        }
+        else
+        {
+            id = spr->id;
+            draw_sprite(id, chr, ((spr->attr & PPU_SPR_PAL) << 2) | (1 << 4), spr->attr >> 6, 1, spr->x, spr->y);
+        }
+    }
+}
+
+void render_list_begin(void)
+{
+    render_list.row_count = 0;
+    render_list.spr_count = 0;
+}
+
+// same fetch as draw_bg_row, recorded instead of drawn
+void render_list_row(sint32 row)
+{
+    uint32 table_addr = 0x2000 + (PPU_CTRL & 3) * 0x400;
+    sint32 scroll_x = PPU_SCROLL_X(PPU_SCROLL);
+    sint32 scroll_y = PPU_SCROLL_Y(PPU_SCROLL);
+    sint32 cx = (scroll_x >> 3);
+    sint32 y = (scroll_y >> 3) + row;
+    sint32 x;
+    RENDER_ROW *r;
+
+    if (render_list.row_count >= RENDER_ROWS)
+        return;
+
+    r = render_list.row + render_list.row_count++;
+    r->x = -(scroll_x & 7);
+    r->y = row * 8 - (scroll_y & 7);
+    r->chr = (PPU_CTRL & PPU_CTRL_PAT_BG) >> 4;
+    r->count = 32 + ((PPU_MASK & PPU_MASK_BG_TRIM) ? 1 : 0);
+
+    pal_update();
+    memcpy(r->pal, table_pal, sizeof(r->pal));
+
+    if (y >= 30)
+    {
+        table_addr += 0x800;
+        y -= 30;
+    }
+
+    for (x = 0; x < r->count; x++, cx++)
+    {
+        uint8 *table;
+
+        if (cx >= 32)
+        {
+            table_addr += 0x400;
+            cx -= 32;
+        }
+
+        table = get_vram_ptr(table_addr);
+        r->tile[x] = table[y * 32 + cx];
+        r->attr[x] = (table[30 * 32 + ((y >> 2) << 3) + (cx >> 2)] >> ((cx & 2) | ((y & 2) << 1))) & 3;
+    }
+}
+
+void render_list_spr(void)
+{
+    uint32 i, n, chr = (PPU_CTRL & PPU_CTRL_PAT_SP) >> 4;
+    uint32 tall = (PPU_CTRL & PPU_CTRL_SIZE) ? 1 : 0;
+    const PPU_SPRITE *spr = oam;
+
+    pal_update();
+    memcpy(render_list.spr_pal, table_pal, sizeof(render_list.spr_pal));
+
+    for (i = 0; i < 64; i++, spr++)
+    {
+        if (spr->y >= 0xEF)
+            continue;
+
+        for (n = 0; n <= tall; n++)
+        {
+            RENDER_SPRITE *s = render_list.spr + render_list.spr_count++;
+            s->x = spr->x;
+            s->y = spr->y + n * 8;
+            s->tile = tall ? ((spr->id & ~1) + n) : spr->id;
+            s->chr = tall ? (spr->id & 1) : chr;
+            s->pal = spr->attr & PPU_SPR_PAL;
+            s->flags = (spr->attr >> 6) | ((spr->attr & PPU_SPR_PRIO) ? RENDER_SPR_BEHIND : 0);
+        }
+    }
+}
+
+uint8 *render_soft_target = SCREEN;
+
+// software consumer, matches the direct path (sprites are drawn in OAM order over the background)
+void render_soft_draw(const RENDER_LIST *list)
+{
+    uint32 i, x;
+
+    for (i = 0; i < list->row_count; i++)
+    {
+        const RENDER_ROW *r = list->row + i;
+        for (x = 0; x < r->count; x++)
+        {
+            draw_tile(render_soft_target, r->pal, r->tile[x], r->chr, r->attr[x] << 2, 0, 0, r->x + x * 8, r->y);
+        }
+    }
+
+    for (i = 0; i < list->spr_count; i++)
+    {
+        const RENDER_SPRITE *s = list->spr + i;
+        draw_tile(render_soft_target, list->spr_pal, s->tile, s->chr, (s->pal << 2) | (1 << 4), s->flags & (RENDER_SPR_FLIP_H | RENDER_SPR_FLIP_V), 1, s->x, s->y);
+    }
+}
+
+const RENDER_BACKEND render_soft = { "soft", render_soft_draw };
+
+#endif
@@ -0,0 +1,333 @@
+#ifndef SCALE_H
+#define SCALE_H
+
+#include "common.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define SCALE_SSE2
+    #include <emmintrin.h>
+#elif defined(__ARM_NEON)
+    #define SCALE_NEON
+    #include <arm_neon.h>
+#endif
+
+#define SCALE_NONE          0
+#define SCALE_NEAREST2X     1
+#define SCALE_NEAREST3X     2
+#define SCALE_2X            3
+#define SCALE_3X            4
+#define SCALE_COUNT         5
+
+static const uint32 scale_factor[SCALE_COUNT] = { 1, 2, 3, 2, 3 };
+const char *scale_name[SCALE_COUNT] = { "none", "nearest2x", "nearest3x", "scale2x", "scale3x" };
+
+uint32 scale_simd = 1; // vector path for 32-bit pixels, 16-bit pixels are always scalar
+
+// scalar rows for [x0, x1), b/e/h are the rows above, current and below (clamped at the edges)
+#define SCALE_IMPL(T, S)\
+void scale_nearest_row_##S(T *d, const T *e, uint32 f, uint32 x0, uint32 x1)\
+{\
+    uint32 x, i;\
+    for (x = x0; x < x1; x++)\
+    {\
+        for (i = 0; i < f; i++)\
+        {\
+            d[x * f + i] = e[x];\
+        }\
+    }\
+}\
+\
+void scale2x_row_##S(T *d0, T *d1, const T *b, const T *e, const T *h, uint32 x0, uint32 x1, uint32 w)\
+{\
+    uint32 x;\
+    for (x = x0; x < x1; x++)\
+    {\
+        uint32 l = x ? x - 1 : 0;\
+        uint32 r = (x + 1 < w) ? x + 1 : x;\
+        T B = b[x], D = e[l], E = e[x], F = e[r], H = h[x];\
+        T *p0 = d0 + x * 2;\
+        T *p1 = d1 + x * 2;\
+        if (B != H && D != F)\
+        {\
+            p0[0] = (D == B) ? D : E;\
+            p0[1] = (B == F) ? F : E;\
+            p1[0] = (D == H) ? D : E;\
+            p1[1] = (H == F) ? F : E;\
+        }\
+        else\
+        {\
+            p0[0] = p0[1] = p1[0] = p1[1] = E;\
+        }\
+    }\
+}\
+\
+void scale3x_row_##S(T *d0, T *d1, T *d2, const T *b, const T *e, const T *h, uint32 x0, uint32 x1, uint32 w)\
+{\
+    uint32 x;\
+    for (x = x0; x < x1; x++)\
+    {\
+        uint32 l = x ? x - 1 : 0;\
+        uint32 r = (x + 1 < w) ? x + 1 : x;\
+        T A = b[l], B = b[x], C = b[r];\
+        T D = e[l], E = e[x], F = e[r];\
+        T G = h[l], H = h[x], I = h[r];\
+        T *p0 = d0 + x * 3;\
+        T *p1 = d1 + x * 3;\
+        T *p2 = d2 + x * 3;\
+        if (B != H && D != F)\
+        {\
+            p0[0] = (D == B) ? D : E;\
+            p0[1] = ((D == B && E != C) || (B == F && E != A)) ? B : E;\
+            p0[2] = (B == F) ? F : E;\
+            p1[0] = ((D == B && E != G) || (D == H && E != A)) ? D : E;\
+            p1[1] = E;\
+            p1[2] = ((B == F && E != I) || (H == F && E != C)) ? F : E;\
+            p2[0] = (D == H) ? D : E;\
+            p2[1] = ((D == H && E != I) || (H == F && E != G)) ? H : E;\
+            p2[2] = (H == F) ? F : E;\
+        }\
+        else\
+        {\
+            p0[0] = p0[1] = p0[2] = E;\
+            p1[0] = p1[1] = p1[2] = E;\
+            p2[0] = p2[1] = p2[2] = E;\
+        }\
+    }\
+}
+
+SCALE_IMPL(uint16, 16)
+SCALE_IMPL(uint32, 32)
+
+#if defined(SCALE_SSE2)
+#define SCALE_EQ(a, b)          _mm_cmpeq_epi32(a, b)
+#define SCALE_SEL(m, a, b)      _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b))
+#define SCALE_ANDNOT(a, b)      _mm_andnot_si128(b, a) // a & ~b
+#define SCALE_OR(a, b)          _mm_or_si128(a, b)
+#define SCALE_LOAD(p)           _mm_loadu_si128((const __m128i*)(p))
+typedef __m128i scale_vec;
+
+static void scale_store2(uint32 *d, __m128i a, __m128i b)
+{
+    _mm_storeu_si128((__m128i*)d + 0, _mm_unpacklo_epi32(a, b));
+    _mm_storeu_si128((__m128i*)d + 1, _mm_unpackhi_epi32(a, b));
+}
+
+static void scale_store3(uint32 *d, __m128i a, __m128i b, __m128i c)
+{
+    __m128 ab_lo = _mm_castsi128_ps(_mm_unpacklo_epi32(a, b)); // a0 b0 a1 b1
+    __m128 ab_hi = _mm_castsi128_ps(_mm_unpackhi_epi32(a, b)); // a2 b2 a3 b3
+    __m128 ca_lo = _mm_castsi128_ps(_mm_unpacklo_epi32(c, a)); // c0 a0 c1 a1
+    __m128 ca_hi = _mm_castsi128_ps(_mm_unpackhi_epi32(c, a)); // c2 a2 c3 a3
+    __m128 bc_lo = _mm_castsi128_ps(_mm_unpacklo_epi32(b, c)); // b0 c0 b1 c1
+    __m128 bc_hi = _mm_castsi128_ps(_mm_unpackhi_epi32(b, c)); // b2 c2 b3 c3
+    _mm_storeu_ps((float*)d + 0, _mm_shuffle_ps(ab_lo, ca_lo, _MM_SHUFFLE(3, 0, 1, 0))); // a0 b0 c0 a1
+    _mm_storeu_ps((float*)d + 4, _mm_shuffle_ps(bc_lo, ab_hi, _MM_SHUFFLE(1, 0, 3, 2))); // b1 c1 a2 b2
+    _mm_storeu_ps((float*)d + 8, _mm_shuffle_ps(ca_hi, bc_hi, _MM_SHUFFLE(3, 2, 3, 0))); // c2 a3 b3 c3
+}
+#elif defined(SCALE_NEON)
+#define SCALE_EQ(a, b)          vceqq_u32(a, b)
+#define SCALE_SEL(m, a, b)      vbslq_u32(m, a, b)
+#define SCALE_ANDNOT(a, b)      vbicq_u32(a, b)
+#define SCALE_OR(a, b)          vorrq_u32(a, b)
+#define SCALE_LOAD(p)           vld1q_u32(p)
+typedef uint32x4_t scale_vec;
+
+static void scale_store2(uint32 *d, uint32x4_t a, uint32x4_t b)
+{
+    uint32x4x2_t v;
+    v.val[0] = a;
+    v.val[1] = b;
+    vst2q_u32(d, v);
+}
+
+static void scale_store3(uint32 *d, uint32x4_t a, uint32x4_t b, uint32x4_t c)
+{
+    uint32x4x3_t v;
+    v.val[0] = a;
+    v.val[1] = b;
+    v.val[2] = c;
+    vst3q_u32(d, v);
+}
+#endif
+
+// 32-bit rows, vector body with scalar edges
+void scale_nearest_row(uint32 *d, const uint32 *e, uint32 f, uint32 w)
+{
+    uint32 x = 0;
+#if defined(SCALE_SSE2) || defined(SCALE_NEON)
+    if (scale_simd && f == 2)
+    {
+        for (; x + 4 <= w; x += 4)
+        {
+            scale_vec E = SCALE_LOAD(e + x);
+            scale_store2(d + x * 2, E, E);
+        }
+    }
+    else if (scale_simd && f == 3)
+    {
+        for (; x + 4 <= w; x += 4)
+        {
+            scale_vec E = SCALE_LOAD(e + x);
+            scale_store3(d + x * 3, E, E, E);
+        }
+    }
+#endif
+    scale_nearest_row_32(d, e, f, x, w);
+}
+
+void scale2x_row(uint32 *d0, uint32 *d1, const uint32 *b, const uint32 *e, const uint32 *h, uint32 w)
+{
+    uint32 x = 0;
+#if defined(SCALE_SSE2) || defined(SCALE_NEON)
+    if (scale_simd)
+    {
+        scale2x_row_32(d0, d1, b, e, h, 0, 1, w);
+        for (x = 1; x + 5 <= w; x += 4)
+        {
+            scale_vec B = SCALE_LOAD(b + x);
+            scale_vec D = SCALE_LOAD(e + x - 1);
+            scale_vec E = SCALE_LOAD(e + x);
+            scale_vec F = SCALE_LOAD(e + x + 1);
+            scale_vec H = SCALE_LOAD(h + x);
+            scale_vec nb = SCALE_OR(SCALE_EQ(B, H), SCALE_EQ(D, F));
+            scale_vec e0 = SCALE_SEL(SCALE_ANDNOT(SCALE_EQ(D, B), nb), D, E);
+            scale_vec e1 = SCALE_SEL(SCALE_ANDNOT(SCALE_EQ(B, F), nb), F, E);
+            scale_vec e2 = SCALE_SEL(SCALE_ANDNOT(SCALE_EQ(D, H), nb), D, E);
+            scale_vec e3 = SCALE_SEL(SCALE_ANDNOT(SCALE_EQ(H, F), nb), F, E);
+            scale_store2(d0 + x * 2, e0, e1);
+            scale_store2(d1 + x * 2, e2, e3);
+        }
+    }
+#endif
+    scale2x_row_32(d0, d1, b, e, h, x, w, w);
+}
+
+void scale3x_row(uint32 *d0, uint32 *d1, uint32 *d2, const uint32 *b, const uint32 *e, const uint32 *h, uint32 w)
+{
+    uint32 x = 0;
+#if defined(SCALE_SSE2) || defined(SCALE_NEON)
+    if (scale_simd)
+    {
+        scale3x_row_32(d0, d1, d2, b, e, h, 0, 1, w);
+        for (x = 1; x + 5 <= w; x += 4)
+        {
+            scale_vec A = SCALE_LOAD(b + x - 1);
+            scale_vec B = SCALE_LOAD(b + x);
+            scale_vec C = SCALE_LOAD(b + x + 1);
+            scale_vec D = SCALE_LOAD(e + x - 1);
+            scale_vec E = SCALE_LOAD(e + x);
+            scale_vec F = SCALE_LOAD(e + x + 1);
+            scale_vec G = SCALE_LOAD(h + x - 1);
+            scale_vec H = SCALE_LOAD(h + x);
+            scale_vec I = SCALE_LOAD(h + x + 1);
+            scale_vec nb = SCALE_OR(SCALE_EQ(B, H), SCALE_EQ(D, F));
+            scale_vec db = SCALE_ANDNOT(SCALE_EQ(D, B), nb);
+            scale_vec bf = SCALE_ANDNOT(SCALE_EQ(B, F), nb);
+            scale_vec dh = SCALE_ANDNOT(SCALE_EQ(D, H), nb);
+            scale_vec hf = SCALE_ANDNOT(SCALE_EQ(H, F), nb);
+            scale_vec ea = SCALE_EQ(E, A);
+            scale_vec ec = SCALE_EQ(E, C);
+            scale_vec eg = SCALE_EQ(E, G);
+            scale_vec ei = SCALE_EQ(E, I);
+            scale_vec e0 = SCALE_SEL(db, D, E);
+            scale_vec e1 = SCALE_SEL(SCALE_OR(SCALE_ANDNOT(db, ec), SCALE_ANDNOT(bf, ea)), B, E);
+            scale_vec e2 = SCALE_SEL(bf, F, E);
+            scale_vec e3 = SCALE_SEL(SCALE_OR(SCALE_ANDNOT(db, eg), SCALE_ANDNOT(dh, ea)), D, E);
+            scale_vec e5 = SCALE_SEL(SCALE_OR(SCALE_ANDNOT(bf, ei), SCALE_ANDNOT(hf, ec)), F, E);
+            scale_vec e6 = SCALE_SEL(dh, D, E);
+            scale_vec e7 = SCALE_SEL(SCALE_OR(SCALE_ANDNOT(dh, ei), SCALE_ANDNOT(hf, eg)), H, E);
+            scale_vec e8 = SCALE_SEL(hf, F, E);
+            scale_store3(d0 + x * 3, e0, e1, e2);
+            scale_store3(d1 + x * 3, e3, E, e5);
+            scale_store3(d2 + x * 3, e6, e7, e8);
+        }
+    }
+#endif
+    scale3x_row_32(d0, d1, d2, b, e, h, x, w, w);
+}
+
+// scales a FRAME_WIDTH x FRAME_HEIGHT frame of 2 or 4 byte pixels, pitch is in bytes
+void scale_frame(uint32 scaler, void *dst, uint32 pitch, const void *src, uint32 bpp)
+{
+    uint32 f = scale_factor[scaler];
+    uint32 stride = FRAME_WIDTH * bpp;
+    uint32 y, i;
+
+    ASSERT(scaler < SCALE_COUNT);
+    ASSERT(bpp == 2 || bpp == 4);
+
+    for (y = 0; y < FRAME_HEIGHT; y++)
+    {
+        const uint8 *e = (const uint8*)src + y * stride;
+        const uint8 *b = y ? e - stride : e;
+        const uint8 *h = (y + 1 < FRAME_HEIGHT) ? e + stride : e;
+        uint8 *d = (uint8*)dst + y * f * pitch;
+
+        if (scaler == SCALE_2X)
+        {
+            if (bpp == 4)
+                scale2x_row((uint32*)d, (uint32*)(d + pitch), (const uint32*)b, (const uint32*)e, (const uint32*)h, FRAME_WIDTH);
+            else
+                scale2x_row_16((uint16*)d, (uint16*)(d + pitch), (const uint16*)b, (const uint16*)e, (const uint16*)h, 0, FRAME_WIDTH, FRAME_WIDTH);
+        }
+        else if (scaler == SCALE_3X)
+        {
+            if (bpp == 4)
+                scale3x_row((uint32*)d, (uint32*)(d + pitch), (uint32*)(d + pitch * 2), (const uint32*)b, (const uint32*)e, (const uint32*)h, FRAME_WIDTH);
+            else
+                scale3x_row_16((uint16*)d, (uint16*)(d + pitch), (uint16*)(d + pitch * 2), (const uint16*)b, (const uint16*)e, (const uint16*)h, 0, FRAME_WIDTH, FRAME_WIDTH);
+        }
+        else
+        {
+            if (bpp == 4)
+                scale_nearest_row((uint32*)d, (const uint32*)e, f, FRAME_WIDTH);
+            else
+                scale_nearest_row_16((uint16*)d, (const uint16*)e, f, 0, FRAME_WIDTH);
+
+            for (i = 1; i < f; i++)
+            {
+                memcpy(d + i * pitch, d, stride * f);
+            }
+        }
+    }
+}
+
+// compares the vector rows against the scalar ones on a synthetic frame, returns mismatch count
+uint32 scale_check(void)
+{
+    static uint32 src[FRAME_WIDTH * FRAME_HEIGHT];
+    static uint32 ref[FRAME_WIDTH * FRAME_HEIGHT * 9];
+    static uint32 out[FRAME_WIDTH * FRAME_HEIGHT * 9];
+    uint32 scaler, i, errors = 0;
+    uint32 simd = scale_simd;
+    uint32 seed = 1;
+
+    // few colours in short runs so the edge rules actually trigger
+    for (i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; i++)
+    {
+        if ((i & 3) == 0)
+        {
+            seed = seed * 1103515245 + 12345;
+        }
+        src[i] = (seed >> 16) & 3;
+    }
+
+    for (scaler = 0; scaler < SCALE_COUNT; scaler++)
+    {
+        uint32 pitch = FRAME_WIDTH * scale_factor[scaler] * 4;
+        uint32 size = pitch * FRAME_HEIGHT * scale_factor[scaler];
+        scale_simd = 0;
+        scale_frame(scaler, ref, pitch, src, 4);
+        scale_simd = 1;
+        scale_frame(scaler, out, pitch, src, 4);
+        if (memcmp(ref, out, size))
+        {
+            errors++;
+        }
+    }
+
+    scale_simd = simd;
+    return errors;
+}
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef SRAM_H
+#define SRAM_H
+
+// battery-backed PRG-RAM, mapped from a .sav file next to the ROM
+// cpu_write only marks 256-byte pages in prg_ram_dirty, the file is synced at frame boundaries and on close
+
+#include <stdio.h>
+
+#include "common.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+uint32 sram_enabled = 1;        // frontends clear it to run without touching save files
+uint8 *sram_view;               // mapped file or NULL
+FILE *sram_file;                // fallback when the file can't be mapped
+
+#ifdef _WIN32
+    HANDLE sram_handle = INVALID_HANDLE_VALUE;
+    HANDLE sram_mapping;
+#else
+    int sram_fd = -1;
+#endif
+
+// "roms/smb.nes" -> "roms/smb.sav"
+void sram_path(char *path, uint32 size, const char *rom)
+{
+    char *ext;
+    char *dir;
+
+    snprintf(path, size - 4, "%s", rom);
+    ext = strrchr(path, '.');
+    dir = strrchr(path, '/');
+    if (!dir)
+        dir = strrchr(path, '\\');
+
+    if (ext && (!dir || ext > dir))
+        *ext = 0;
+    strcat(path, ".sav");
+}
+
+static uint32 sram_map(const char *path)
+{
+#ifdef _WIN32
+    sram_handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (sram_handle == INVALID_HANDLE_VALUE)
+        return 0;
+
+    // the mapping extends new or short files to PRG_RAM_SIZE
+    sram_mapping = CreateFileMappingA(sram_handle, NULL, PAGE_READWRITE, 0, PRG_RAM_SIZE, NULL);
+    if (sram_mapping)
+    {
+        sram_view = (uint8*)MapViewOfFile(sram_mapping, FILE_MAP_WRITE, 0, 0, PRG_RAM_SIZE);
+    }
+#else
+    struct stat st;
+
+    sram_fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (sram_fd < 0)
+        return 0;
+
+    if (fstat(sram_fd, &st) == 0 && (st.st_size >= PRG_RAM_SIZE || ftruncate(sram_fd, PRG_RAM_SIZE) == 0))
+    {
+        void *view = mmap(NULL, PRG_RAM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, sram_fd, 0);
+        if (view != MAP_FAILED)
+        {
+            sram_view = (uint8*)view;
+        }
+    }
+#endif
+    return sram_view != NULL;
+}
+
+static void sram_unmap(void)
+{
+#ifdef _WIN32
+    if (sram_view)
+    {
+        FlushViewOfFile(sram_view, PRG_RAM_SIZE);
+        UnmapViewOfFile(sram_view);
+    }
+    if (sram_mapping)
+    {
+        CloseHandle(sram_mapping);
+        sram_mapping = NULL;
+    }
+    if (sram_handle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(sram_handle);
+        sram_handle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (sram_view)
+    {
+        msync(sram_view, PRG_RAM_SIZE, MS_SYNC);
+        munmap(sram_view, PRG_RAM_SIZE);
+    }
+    if (sram_fd >= 0)
+    {
+        close(sram_fd);
+        sram_fd = -1;
+    }
+#endif
+    sram_view = NULL;
+}
+
+void sram_flush(void)
+{
+    uint32 lo, hi, start, size;
+
+    if (!prg_ram_dirty)
+        return;
+
+    for (lo = 0; !(prg_ram_dirty & (1u << lo)); lo++);
+    for (hi = 31; !(prg_ram_dirty & (1u << hi)); hi--);
+    prg_ram_dirty = 0;
+
+    start = lo * 256;
+    size = (hi + 1) * 256 - start;
+
+    if (sram_view)
+    {
+    #ifdef _WIN32
+        FlushViewOfFile(sram_view + start, size);
+    #else
+        // msync wants a page aligned address, the view itself is page aligned
+        uint32 align = start & (uint32)(sysconf(_SC_PAGESIZE) - 1);
+        msync(sram_view + start - align, size + align, MS_ASYNC);
+    #endif
+    }
+    else if (sram_file)
+    {
+        fseek(sram_file, start, SEEK_SET);
+        fwrite(prg_ram + start, 1, size, sram_file);
+        fflush(sram_file);
+    }
+}
+
+void sram_close(void)
+{
+    sram_flush();
+    sram_unmap();
+
+    if (sram_file)
+    {
+        fclose(sram_file);
+        sram_file = NULL;
+    }
+
+    prg_ram = prg_ram_buf;
+}
+
+// maps the .sav file for the ROM as PRG-RAM, returns 0 if there is no backing file at all
+sint32 sram_open(const char *rom)
+{
+    char path[1024];
+
+    sram_close();
+    sram_path(path, sizeof(path), rom);
+
+    if (sram_map(path))
+    {
+        prg_ram = sram_view;
+        return 1;
+    }
+    sram_unmap();
+
+    memset(prg_ram_buf, 0, sizeof(prg_ram_buf));
+    sram_file = fopen(path, "r+b");
+    if (sram_file)
+    {
+        fread(prg_ram_buf, 1, sizeof(prg_ram_buf), sram_file);
+    }
+    else
+    {
+        sram_file = fopen(path, "w+b");
+    }
+    if (sram_file)
+    {
+        prg_ram_dirty = 0xFFFFFFFF; // write the whole image on the first flush
+    }
+
+    return sram_file != NULL;
+}
+
+#endif
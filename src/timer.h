@@ -0,0 +1,30 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "common.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+uint64 time_ns(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER t;
+    if (!freq.QuadPart)
+    {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&t);
+    return (uint64)((double)t.QuadPart * 1000000000.0 / (double)freq.QuadPart);
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64)t.tv_sec * 1000000000ULL + (uint64)t.tv_nsec;
+#endif
+}
+
+#endif
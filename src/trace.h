@@ -0,0 +1,124 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// in-memory instruction trace, build with TRACE defined
+// records are packed binary and only formatted as nestest-style text when dumped
+
+#ifdef TRACE
+
+#include <stdio.h>
+
+#include "common.h"
+#include "cpu.h"
+
+#ifndef TRACE_SIZE
+    #define TRACE_SIZE      (1 << 16) // records, power of two
+#endif
+
+typedef struct
+{
+    uint32 cycles;                  // low 32 bits of cpu_cycles
+    uint16 pc;
+    uint8 op[3];
+    uint8 a, x, y, p, s;
+    uint8 pad[2];
+} TRACE_RECORD;
+
+TRACE_RECORD trace_ring[TRACE_SIZE];
+uint32 trace_pos;                   // total records written
+
+// operand bytes are peeked directly so tracing never triggers I/O side effects
+static uint8 trace_peek(uint32 addr)
+{
+    const uint8 *page = cpu_page_ptr(addr & 0xFF00);
+    return page ? page[addr & 0xFF] : 0;
+}
+
+void trace_op(void)
+{
+    TRACE_RECORD *r = trace_ring + (trace_pos++ & (TRACE_SIZE - 1));
+    r->cycles = (uint32)cpu_cycles;
+    r->pc = (uint16)PC;
+    r->op[0] = trace_peek(PC);
+    r->op[1] = trace_peek((PC + 1) & 0xFFFF);
+    r->op[2] = trace_peek((PC + 2) & 0xFFFF);
+    r->a = (uint8)A;
+    r->x = (uint8)X;
+    r->y = (uint8)Y;
+    r->p = (uint8)P;
+    r->s = (uint8)S;
+}
+
+// nestest.log layout without the "= xx" memory annotations and the PPU column
+void trace_format(const TRACE_RECORD *r, char *buf)
+{
+    uint32 op = r->op[0];
+    uint32 len = op_len[op];
+    uint32 lo = r->op[1];
+    uint32 abs = r->op[1] | (r->op[2] << 8);
+    const char *name = op_name[op];
+    const char *mode = op_mode[op];
+    char bytes[16], args[32];
+
+    if (len == 1)
+        sprintf(bytes, "%02X", op);
+    else if (len == 2)
+        sprintf(bytes, "%02X %02X", op, r->op[1]);
+    else
+        sprintf(bytes, "%02X %02X %02X", op, r->op[1], r->op[2]);
+
+    args[0] = 0;
+    if      (!strcmp(name, "ASA")) { name = "ASL"; strcpy(args, "A"); }
+    else if (!strcmp(name, "LSA")) { name = "LSR"; strcpy(args, "A"); }
+    else if (!strcmp(name, "RAL")) { name = "ROL"; strcpy(args, "A"); }
+    else if (!strcmp(name, "RAR")) { name = "ROR"; strcpy(args, "A"); }
+    else if (!strcmp(mode, "IMM")) sprintf(args, "#$%02X", lo);
+    else if (!strcmp(mode, "REL")) sprintf(args, "$%04X", (r->pc + 2 + (sint8)lo) & 0xFFFF);
+    else if (!strcmp(mode, "ZP0")) sprintf(args, "$%02X", lo);
+    else if (!strcmp(mode, "ZPX")) sprintf(args, "$%02X,X", lo);
+    else if (!strcmp(mode, "ZPY")) sprintf(args, "$%02X,Y", lo);
+    else if (!strcmp(mode, "IZX")) sprintf(args, "($%02X,X)", lo);
+    else if (!strcmp(mode, "IZY")) sprintf(args, "($%02X),Y", lo);
+    else if (!strcmp(mode, "ABS")) sprintf(args, "$%04X", abs);
+    else if (!strcmp(mode, "ABX")) sprintf(args, "$%04X,X", abs);
+    else if (!strcmp(mode, "ABY")) sprintf(args, "$%04X,Y", abs);
+    else if (!strcmp(mode, "IND")) sprintf(args, "($%04X)", abs);
+
+    sprintf(buf, "%04X  %-8s  %s %-27s A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%u",
+        r->pc, bytes, name, args, r->a, r->x, r->y, r->p, r->s, r->cycles);
+}
+
+// writes up to count most recent records, oldest first (0 = whole ring)
+sint32 trace_dump(const char *path, uint32 count)
+{
+    char line[128];
+    uint32 n = (trace_pos < TRACE_SIZE) ? trace_pos : TRACE_SIZE;
+    uint32 i;
+    FILE *f = fopen(path, "w");
+
+    if (!f)
+        return 0;
+
+    if (count && count < n)
+    {
+        n = count;
+    }
+
+    for (i = trace_pos - n; i != trace_pos; i++)
+    {
+        trace_format(trace_ring + (i & (TRACE_SIZE - 1)), line);
+        fprintf(f, "%s\n", line);
+    }
+
+    fclose(f);
+    return 1;
+}
+
+void trace_dump_assert(void)
+{
+    trace_dump("trace_assert.log", 0);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,266 @@
+#ifndef VIDEO_H
+#define VIDEO_H
+
+#include "common.h"
+#include "ppu.h"
+
+#if defined(__SSSE3__) || defined(__AVX__)
+    #define VIDEO_SSSE3
+    #include <tmmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    #define VIDEO_NEON
+    #include <arm_neon.h>
+#endif
+
+// SCREEN holds 6-bit NES colour indices, resolved through table_pal at draw time
+// so the output tables only depend on the format and PPU_MASK colour bits
+
+#define VIDEO_RGB555        0
+#define VIDEO_RGB565        1
+#define VIDEO_ARGB8888      2
+#define VIDEO_FORMATS       3
+
+#define VIDEO_EMP_SCALE     205 // ~0.8 attenuation of non-emphasized channels
+
+static const uint32 video_bpp[VIDEO_FORMATS] = { 2, 2, 4 };
+
+uint32 video_format;
+uint32 video_mask = ~0U;            // invalid until the first video_update
+uint8  video_planes[4][64];         // per-byte lookup planes, little endian
+
+uint32 video_pixel(uint32 format, uint32 color)
+{
+    uint32 r = (color >> 16) & 0xFF;
+    uint32 g = (color >> 8) & 0xFF;
+    uint32 b = color & 0xFF;
+
+    switch (format)
+    {
+        case VIDEO_RGB555 : return ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+        case VIDEO_RGB565 : return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    }
+    return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+uint32 video_color(uint32 index, uint32 mask)
+{
+    uint32 color, emp, i;
+
+    index &= 0x3F;
+    if (mask & PPU_MASK_GRAY)
+    {
+        index &= 0x30;
+    }
+    color = screen_pal[index];
+
+    emp = mask & (PPU_MASK_EMP_R | PPU_MASK_EMP_G | PPU_MASK_EMP_B);
+    if (!emp)
+        return color;
+
+    // R, G, B emphasis bits darken the two other channels
+    for (i = 0; i < 3; i++)
+    {
+        uint32 keep = (i == 0) ? PPU_MASK_EMP_B : ((i == 1) ? PPU_MASK_EMP_G : PPU_MASK_EMP_R);
+        if (!(emp & keep) || emp == (PPU_MASK_EMP_R | PPU_MASK_EMP_G | PPU_MASK_EMP_B))
+        {
+            uint32 c = (color >> (i * 8)) & 0xFF;
+            color &= ~(0xFF << (i * 8));
+            color |= ((c * VIDEO_EMP_SCALE) >> 8) << (i * 8);
+        }
+    }
+    return color;
+}
+
+// rebuilds the lookup planes only when the format or colour bits change
+void video_update(uint32 format, uint32 mask)
+{
+    uint32 i;
+
+    ASSERT(format < VIDEO_FORMATS);
+    mask &= PPU_MASK_COLOR;
+
+    if (format == video_format && mask == video_mask)
+        return;
+
+    video_format = format;
+    video_mask = mask;
+
+    for (i = 0; i < 64; i++)
+    {
+        uint32 p = video_pixel(format, video_color(i, mask));
+        video_planes[0][i] = p & 0xFF;
+        video_planes[1][i] = (p >> 8) & 0xFF;
+        video_planes[2][i] = (p >> 16) & 0xFF;
+        video_planes[3][i] = (p >> 24) & 0xFF;
+    }
+}
+
+uint32 video_lookup(uint32 index)
+{
+    index &= 0x3F;
+    return video_planes[0][index] | (video_planes[1][index] << 8) | (video_planes[2][index] << 16) | ((uint32)video_planes[3][index] << 24);
+}
+
+// scalar reference
+void video_convert_ref(void *dst, const uint8 *src, uint32 count)
+{
+    uint32 i;
+    if (video_bpp[video_format] == 2)
+    {
+        uint16 *out = (uint16*)dst;
+        for (i = 0; i < count; i++)
+        {
+            out[i] = (uint16)video_lookup(src[i]);
+        }
+    }
+    else
+    {
+        uint32 *out = (uint32*)dst;
+        for (i = 0; i < count; i++)
+        {
+            out[i] = video_lookup(src[i]);
+        }
+    }
+}
+
+#ifdef VIDEO_SSSE3
+// 64-entry byte lookup as four 16-entry shuffles selected by bits 4..5
+static __m128i video_lookup_sse(const __m128i *tbl, __m128i idx)
+{
+    __m128i hi = _mm_and_si128(idx, _mm_set1_epi8(0x30));
+    __m128i r;
+    r =                  _mm_and_si128(_mm_shuffle_epi8(tbl[0], idx), _mm_cmpeq_epi8(hi, _mm_setzero_si128()));
+    r = _mm_or_si128(r,  _mm_and_si128(_mm_shuffle_epi8(tbl[1], idx), _mm_cmpeq_epi8(hi, _mm_set1_epi8(0x10))));
+    r = _mm_or_si128(r,  _mm_and_si128(_mm_shuffle_epi8(tbl[2], idx), _mm_cmpeq_epi8(hi, _mm_set1_epi8(0x20))));
+    r = _mm_or_si128(r,  _mm_and_si128(_mm_shuffle_epi8(tbl[3], idx), _mm_cmpeq_epi8(hi, _mm_set1_epi8(0x30))));
+    return r;
+}
+#endif
+
+void video_convert(void *dst, const uint8 *src, uint32 count)
+{
+    uint32 bpp = video_bpp[video_format];
+    uint32 i = 0;
+
+#if defined(VIDEO_SSSE3)
+    __m128i tbl[4][4];
+    __m128i m = _mm_set1_epi8(0x3F);
+    uint32 p, k;
+
+    for (p = 0; p < bpp; p++)
+    {
+        for (k = 0; k < 4; k++)
+        {
+            tbl[p][k] = _mm_loadu_si128((const __m128i*)(video_planes[p] + k * 16));
+        }
+    }
+
+    if (bpp == 2)
+    {
+        __m128i *out = (__m128i*)dst;
+        for (; i + 16 <= count; i += 16, out += 2)
+        {
+            __m128i idx = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + i)), m);
+            __m128i lo = video_lookup_sse(tbl[0], idx);
+            __m128i hi = video_lookup_sse(tbl[1], idx);
+            _mm_storeu_si128(out + 0, _mm_unpacklo_epi8(lo, hi));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(lo, hi));
+        }
+    }
+    else
+    {
+        __m128i *out = (__m128i*)dst;
+        for (; i + 16 <= count; i += 16, out += 4)
+        {
+            __m128i idx = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + i)), m);
+            __m128i b = video_lookup_sse(tbl[0], idx);
+            __m128i g = video_lookup_sse(tbl[1], idx);
+            __m128i r = video_lookup_sse(tbl[2], idx);
+            __m128i a = video_lookup_sse(tbl[3], idx);
+            __m128i bg_lo = _mm_unpacklo_epi8(b, g);
+            __m128i bg_hi = _mm_unpackhi_epi8(b, g);
+            __m128i ra_lo = _mm_unpacklo_epi8(r, a);
+            __m128i ra_hi = _mm_unpackhi_epi8(r, a);
+            _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(bg_lo, ra_lo));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(bg_lo, ra_lo));
+            _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(bg_hi, ra_hi));
+            _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(bg_hi, ra_hi));
+        }
+    }
+#elif defined(VIDEO_NEON)
+    uint8x16x4_t tbl[4];
+    uint8x16_t m = vdupq_n_u8(0x3F);
+    uint32 p;
+
+    for (p = 0; p < bpp; p++)
+    {
+        tbl[p] = vld1q_u8_x4(video_planes[p]);
+    }
+
+    if (bpp == 2)
+    {
+        uint8 *out = (uint8*)dst;
+        for (; i + 16 <= count; i += 16, out += 32)
+        {
+            uint8x16_t idx = vandq_u8(vld1q_u8(src + i), m);
+            uint8x16x2_t v;
+            v.val[0] = vqtbl4q_u8(tbl[0], idx);
+            v.val[1] = vqtbl4q_u8(tbl[1], idx);
+            vst2q_u8(out, v);
+        }
+    }
+    else
+    {
+        uint8 *out = (uint8*)dst;
+        for (; i + 16 <= count; i += 16, out += 64)
+        {
+            uint8x16_t idx = vandq_u8(vld1q_u8(src + i), m);
+            uint8x16x4_t v;
+            v.val[0] = vqtbl4q_u8(tbl[0], idx);
+            v.val[1] = vqtbl4q_u8(tbl[1], idx);
+            v.val[2] = vqtbl4q_u8(tbl[2], idx);
+            v.val[3] = vqtbl4q_u8(tbl[3], idx);
+            vst4q_u8(out, v);
+        }
+    }
+#endif
+
+    // tail (or whole frame without SIMD)
+    video_convert_ref((uint8*)dst + i * bpp, src + i, count - i);
+}
+
+// compares the vector kernel against the reference for every format, returns mismatch count
+uint32 video_check(void)
+{
+    static uint8 src[1024 + 7];
+    static uint32 ref[sizeof(src)];
+    static uint32 out[sizeof(src)];
+    static const uint32 masks[] = { 0, PPU_MASK_GRAY, PPU_MASK_EMP_R, PPU_MASK_EMP_G | PPU_MASK_EMP_B, PPU_MASK_COLOR };
+    uint32 format, m, i, errors = 0;
+
+    for (i = 0; i < sizeof(src); i++)
+    {
+        src[i] = (uint8)(i * 7 + (i >> 8));
+    }
+
+    for (format = 0; format < VIDEO_FORMATS; format++)
+    {
+        for (m = 0; m < sizeof(masks) / sizeof(masks[0]); m++)
+        {
+            video_update(format, masks[m]);
+            memset(ref, 0, sizeof(ref));
+            memset(out, 0xCD, sizeof(out));
+            video_convert_ref(ref, src, sizeof(src));
+            video_convert(out, src, sizeof(src));
+            if (memcmp(ref, out, sizeof(src) * video_bpp[format]))
+            {
+                errors++;
+            }
+        }
+    }
+
+    video_mask = ~0U;
+    return errors;
+}
+
+#endif
@@ -1,29 +1,19 @@
 #include <stdio.h>
 #include <windows.h>
 
-#include "common.h"
-#include "cart.h"
-#include "cpu.h"
-#include "ppu.h"
-#include "apu.h"
-
-uint8 mem[256 * 1024];
-
-sint32 nes_load(const char *path)
-{
-    FILE *f = fopen(path, "rb");
-    if (!f)
-        return 0;
-    fread(mem, 1, sizeof(mem), f);
-    fclose(f);
-    return 1;
-}
+#include "nes.h"
+#include "video.h"
+#include "scale.h"
 
 #define WND_SCALE       3
 #define WND_WIDTH       (FRAME_WIDTH * WND_SCALE)
 #define WND_HEIGHT      (FRAME_HEIGHT * WND_SCALE)
+#define WND_FORMAT      VIDEO_ARGB8888 // or VIDEO_RGB555, GDI has no plain 565 DIB
 
-uint32 SCREEN[FRAME_WIDTH * FRAME_HEIGHT];
+uint32 FRAME[FRAME_WIDTH * FRAME_HEIGHT];
+uint32 FRAME_SCALED[WND_WIDTH * WND_HEIGHT];
+uint32 scaler = SCALE_NEAREST3X;
+uint8 joy_live[2];
 
 HWND hWnd;
 HDC hDC;
@@ -35,7 +25,7 @@ LRESULT CALLBACK app_proc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
     {
         case WM_ACTIVATE:
         {
-            joy_state[0] = joy_state[1] = 0;
+            joy_live[0] = joy_live[1] = 0;
             break;
         }
 
@@ -52,6 +42,30 @@ LRESULT CALLBACK app_proc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
         case WM_SYSKEYDOWN :
         {
             uint8 key = 0;
+
+            if (wParam >= VK_F1 && wParam < VK_F1 + SCALE_COUNT)
+            {
+                scaler = (uint32)(wParam - VK_F1);
+                break;
+            }
+
+        #ifdef TRACE
+            // F10 is a system key, it never arrives as WM_KEYDOWN
+            if (wParam == VK_F10 && msg == WM_SYSKEYDOWN)
+            {
+                trace_dump("trace.log", 0);
+                break;
+            }
+        #endif
+
+        #ifdef PERF
+            if (wParam == VK_F11 && msg == WM_KEYDOWN)
+            {
+                perf_overlay ^= 1;
+                break;
+            }
+        #endif
+
             switch (wParam)
             {
                 case VK_RIGHT  : key = (1 << 0); break; // R
@@ -65,9 +79,9 @@ LRESULT CALLBACK app_proc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
             }
 
             if (msg != WM_KEYUP && msg != WM_SYSKEYUP) {
-                joy_state[0] |= key;
+                joy_live[0] |= key;
             } else {
-                joy_state[0] &= ~key;
+                joy_live[0] &= ~key;
             }
 
             break;
@@ -104,6 +118,9 @@ void app_init(void)
     hDC = GetDC(hWnd);
 
     ShowWindow(hWnd, SW_SHOWDEFAULT);
+
+    ASSERT(video_check() == 0);
+    ASSERT(scale_check() == 0);
 }
 
 void app_messages(void)
@@ -116,168 +133,88 @@ void app_messages(void)
     }
 }
 
-void pal_update()
+void app_blit(void)
 {
-    table_pal[0x10] =
-    table_pal[0x14] =
-    table_pal[0x18] =
-    table_pal[0x1C] = table_pal[0x00];
-}
+    uint32 bpp = video_bpp[WND_FORMAT];
+    uint32 w = FRAME_WIDTH * scale_factor[scaler];
+    uint32 h = FRAME_HEIGHT * scale_factor[scaler];
+    BITMAPINFO bmi = { sizeof(BITMAPINFOHEADER), w, -(LONG)h, 1, bpp * 8, BI_RGB, 0, 0, 0, 0, 0 };
 
-void draw_sprite(sint32 index, uint32 chr, uint32 pal, uint32 flip, uint32 trans, sint32 x, sint32 y)
-{
-    const uint8 *ptr = (chr_rom + index * 16) + chr * (16 * 16 * 16);
-    sint32 ix, iy, i;
+    video_update(WND_FORMAT, PPU_MASK);
+    video_convert(FRAME, SCREEN, FRAME_WIDTH * FRAME_HEIGHT);
+    scale_frame(scaler, FRAME_SCALED, w * bpp, FRAME, bpp);
 
-    for (iy = 0; iy < 8; iy++)
-    {
-        uint8 a = ptr[iy];
-        uint8 b = ptr[iy + 8];
-
-        for (ix = 0; ix < 8; ix++)
-        {
-            i = (a >> 7) | ((b >> 6) & 2);
-
-            a <<= 1;
-            b <<= 1;
-
-            if (trans && i == 0)
-                continue;
-
-            if (i != 0)
-            {
-                i |= pal;
-            }
-
-            sint32 sx = x + ((flip & 1) ? (7 - ix) : ix);
-            sint32 sy = y + ((flip & 2) ? (7 - iy) : iy);
-
-            if (sx >= 0 && sx <= 255 && sy >= 0 && sy <= 239)
-            {
-                SCREEN[sy * FRAME_WIDTH + sx] = screen_pal[table_pal[i]];
-            }
-        }
-    }
+    // 1:1 when the scaler matches WND_SCALE, otherwise GDI covers the rest
+    StretchDIBits(hDC, 0, 0, WND_WIDTH, WND_HEIGHT, 0, 0, w, h, FRAME_SCALED, &bmi, DIB_RGB_COLORS, SRCCOPY);
+    Sleep(1);
 }
 
-void draw_bg_row(row)
+int main(int argc, char **argv)
 {
-    uint32 table_addr = 0x2000 + (PPU_CTRL & 3) * 0x400;
-    
-    uint32 chr = (PPU_CTRL & PPU_CTRL_PAT_BG) >> 4;
-    sint32 scroll_x = PPU_SCROLL_X(PPU_SCROLL);
-    sint32 scroll_y = PPU_SCROLL_Y(PPU_SCROLL);
-
-    sint32 cx = (scroll_x >> 3);
-    sint32 cy = (scroll_y >> 3);
-    sint32 fx = (scroll_x & 7);
-    sint32 fy = (scroll_y & 7);
-
-    sint32 y, x;
-    sint32 w = 32 + ((PPU_MASK & PPU_MASK_BG_TRIM) ? 1 : 0);
-
-    pal_update();
-
-    y = cy + row;
-    if (y >= 30)
-    {
-        table_addr += 0x800;
-        y -= 30;
-    }
+    const char *record = NULL;
+    const char *replay = NULL;
+    const char *perf = NULL;
+    int i;
 
-    for (x = 0; x < w; x++, cx++)
+    for (i = 1; i + 1 < argc; i += 2)
     {
-        if (cx >= 32)
-        {
-            table_addr += 0x400;
-            cx -= 32;
-        }
-
-        uint8 *table = get_vram_ptr(table_addr);
-
-        uint32 spr = table[y * 32 + cx];
-        uint32 pal = table[30 * 32 + ((y >> 2) << 3) + (cx >> 2)];
-
-        uint32 sx = (cx & 2);
-        uint32 sy = (y & 2) << 1;
-
-        pal = (pal >> (sx | sy)) & 3;
-
-        draw_sprite(spr, chr, (pal << 2), 0, 0, x * 8 - fx, row * 8 - fy);
+        if (!strcmp(argv[i], "-record"))
+            record = argv[i + 1];
+        else if (!strcmp(argv[i], "-replay"))
+            replay = argv[i + 1];
+        else if (!strcmp(argv[i], "-perf"))
+            perf = argv[i + 1];
     }
-}
 
-void draw_spr(void)
-{
-    uint32 i, id;
-    PPU_SPRITE *spr = oam;
-    uint32 chr = (PPU_CTRL & PPU_CTRL_PAT_SP) >> 4;
-
-    pal_update();
-
-    for (i = 0; i < 64; i++, spr++)
+    // movies start from blank PRG-RAM, the .sav file must not be mapped or touched
+    if (record || replay)
     {
-        if (spr->y >= 0xEF)
-            continue;
-
-        if (PPU_CTRL & PPU_CTRL_SIZE)
-        {
-            chr = (spr->id & 1);
-            id = spr->id & ~1;
-            draw_sprite(id, chr, ((spr->attr & PPU_SPR_PAL) << 2) | (1 << 4), spr->attr >> 6, 1, spr->x, spr->y);
-            draw_sprite(id + 1, chr, ((spr->attr & PPU_SPR_PAL) << 2) | (1 << 4), spr->attr >> 6, 1, spr->x, spr->y + 8);
-        }
-        else
-        {
-            id = spr->id;
-            draw_sprite(id, chr, ((spr->attr & PPU_SPR_PAL) << 2) | (1 << 4), spr->attr >> 6, 1, spr->x, spr->y);
-        }
+        sram_enabled = 0;
     }
-}
 
-void app_blit(void)
-{
-    static const BITMAPINFO bmi = { sizeof(BITMAPINFOHEADER), FRAME_WIDTH, -FRAME_HEIGHT, 1, 32, BI_RGB, 0, 0, 0, 0, 0 };
-    StretchDIBits(hDC, 0, 0, WND_WIDTH, WND_HEIGHT, 0, 0, FRAME_WIDTH, FRAME_HEIGHT, SCREEN, &bmi, DIB_RGB_COLORS, SRCCOPY);
-    Sleep(1);
-}
-
-int main()
-{
     app_init();
 
     if (!nes_load("roms\\smb.nes"))
         return -1;
 
-    cart_load(mem);
+    nes_reset();
+
+    // optional, mapper defaults apply without it
+    ppu_tier = nes_tier_select("roms\\tiers.txt");
 
-    cpu_reset();
-    ppu_reset();
-    apu_reset();
+    if (record)
+        movie_record(record);
+    if (replay)
+        movie_replay(replay);
+
+    movie_input(joy_live);
 
     while (!quit)
     {
         app_messages();
 
-        cpu_clock(48);
-        ppu_scan();
-
-        if ((scanline <= 240) && ((scanline & 7) == 0))
+        if (nes_scanline())
         {
-            if (PPU_MASK & PPU_MASK_BG_EN)
-            {
-                draw_bg_row(scanline >> 3);
-            }
+        #ifdef PERF
+            perf_draw(SCREEN);
+        #endif
+            PERF_TIME(PERF_BLIT, app_blit());
+            PERF_FRAME();
+            movie_input(joy_live);
         }
+    }
 
-        if (scanline == 241)
-        {
-            if (PPU_MASK & PPU_MASK_SP_EN)
-            {
-                draw_spr();
-            }
-            app_blit();
-        }
+    movie_close();
+    nes_close();
+
+    if (perf)
+    {
+    #ifdef PERF
+        perf_summary(stdout);
+        perf_dump(perf);
+    #else
+        printf("perf: build with -DPERF\n");
+    #endif
     }
 
     return 0;